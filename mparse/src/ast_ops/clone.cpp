@@ -1,12 +1,17 @@
 #include "clone.h"
 
 #include "mparse/ast.h"
+#include "mparse/traversal.h"
+#include <iterator>
+#include <vector>
 
 namespace ast_ops {
 namespace {
 
-struct clone_visitor : mparse::const_ast_visitor<clone_visitor> {
-  void operator()(const mparse::unary_node& node);
+struct clone_visitor : mparse::const_ast_visitor<clone_visitor>,
+                       mparse::ast_traversal<clone_visitor> {
+  void leave(const mparse::ast_node& node);
+
   void operator()(const mparse::paren_node& node);
   void operator()(const mparse::abs_node& node);
   void operator()(const mparse::unary_op_node& node);
@@ -15,64 +20,112 @@ struct clone_visitor : mparse::const_ast_visitor<clone_visitor> {
   void operator()(const mparse::literal_node& node);
   void operator()(const mparse::id_node& node);
 
-  mparse::ast_node_ptr cloned = nullptr;
+  mparse::ast_node_ptr pop_cloned();
+
+  // clones of the children of nodes currently being visited
+  std::vector<mparse::ast_node_ptr> cloned;
 };
 
 
-void clone_visitor::operator()(const mparse::unary_node& node) {
-  mparse::apply_visitor(*this, *node.child());
+void clone_visitor::leave(const mparse::ast_node& node) {
+  mparse::apply_visitor(*this, node);
 }
 
 void clone_visitor::operator()(const mparse::paren_node&) {
-  cloned = mparse::make_ast_node<mparse::paren_node>(std::move(cloned));
+  cloned.push_back(mparse::make_ast_node<mparse::paren_node>(pop_cloned()));
 }
 
 void clone_visitor::operator()(const mparse::abs_node&) {
-  cloned = mparse::make_ast_node<mparse::abs_node>(std::move(cloned));
+  cloned.push_back(mparse::make_ast_node<mparse::abs_node>(pop_cloned()));
 }
 
 void clone_visitor::operator()(const mparse::unary_op_node& node) {
-  cloned = mparse::make_ast_node<mparse::unary_op_node>(node.type(),
-                                                        std::move(cloned));
+  cloned.push_back(
+      mparse::make_ast_node<mparse::unary_op_node>(node.type(), pop_cloned()));
 }
 
 void clone_visitor::operator()(const mparse::binary_op_node& node) {
-  mparse::apply_visitor(*this, *node.lhs());
-  auto cloned_lhs = std::move(cloned);
+  auto cloned_rhs = pop_cloned();
+  auto cloned_lhs = pop_cloned();
 
-  mparse::apply_visitor(*this, *node.rhs());
-  auto cloned_rhs = std::move(cloned);
-
-  cloned = mparse::make_ast_node<mparse::binary_op_node>(
-      node.type(), std::move(cloned_lhs), std::move(cloned_rhs));
+  cloned.push_back(mparse::make_ast_node<mparse::binary_op_node>(
+      node.type(), std::move(cloned_lhs), std::move(cloned_rhs)));
 }
 
 void clone_visitor::operator()(const mparse::func_node& node) {
-  mparse::func_node::arg_list cloned_args;
-  for (const auto& arg : node.args()) {
-    mparse::apply_visitor(*this, *arg);
-    cloned_args.push_back(std::move(cloned));
-  }
+  auto first_arg = cloned.end() - node.args().size();
 
-  cloned = mparse::make_ast_node<mparse::func_node>(node.name(),
-                                                    std::move(cloned_args));
+  mparse::func_node::arg_list cloned_args(
+      std::make_move_iterator(first_arg),
+      std::make_move_iterator(cloned.end()));
+  cloned.erase(first_arg, cloned.end());
+
+  cloned.push_back(mparse::make_ast_node<mparse::func_node>(
+      node.name(), std::move(cloned_args)));
 }
 
 void clone_visitor::operator()(const mparse::literal_node& node) {
-  cloned = mparse::make_ast_node<mparse::literal_node>(node.val());
+  cloned.push_back(mparse::make_ast_node<mparse::literal_node>(node.val()));
 }
 
 void clone_visitor::operator()(const mparse::id_node& node) {
-  cloned = mparse::make_ast_node<mparse::id_node>(node.name());
+  cloned.push_back(mparse::make_ast_node<mparse::id_node>(node.name()));
+}
+
+mparse::ast_node_ptr clone_visitor::pop_cloned() {
+  auto node = std::move(cloned.back());
+  cloned.pop_back();
+  return node;
 }
 
+
+struct clone_node_visitor : mparse::const_ast_visitor<clone_node_visitor> {
+  void operator()(const mparse::paren_node& node) {
+    result = mparse::make_ast_node<mparse::paren_node>(node.child_ptr());
+  }
+
+  void operator()(const mparse::abs_node& node) {
+    result = mparse::make_ast_node<mparse::abs_node>(node.child_ptr());
+  }
+
+  void operator()(const mparse::unary_op_node& node) {
+    result = mparse::make_ast_node<mparse::unary_op_node>(node.type(),
+                                                          node.child_ptr());
+  }
+
+  void operator()(const mparse::binary_op_node& node) {
+    result = mparse::make_ast_node<mparse::binary_op_node>(
+        node.type(), node.lhs_ptr(), node.rhs_ptr());
+  }
+
+  void operator()(const mparse::func_node& node) {
+    result = mparse::make_ast_node<mparse::func_node>(node.name(), node.args());
+  }
+
+  void operator()(const mparse::literal_node& node) {
+    result = mparse::make_ast_node<mparse::literal_node>(node.val());
+  }
+
+  void operator()(const mparse::id_node& node) {
+    result = mparse::make_ast_node<mparse::id_node>(node.name());
+  }
+
+  mparse::ast_node_ptr result;
+};
+
 } // namespace
 
 
 mparse::ast_node_ptr clone(const mparse::ast_node& node) {
   clone_visitor vis;
+  mparse::traverse(vis, node);
+  return vis.pop_cloned();
+}
+
+mparse::ast_node_ptr clone_node(const mparse::ast_node& node) {
+  clone_node_visitor vis;
   mparse::apply_visitor(vis, node);
-  return vis.cloned;
+  return std::move(vis.result);
 }
 
 } // namespace ast_ops
\ No newline at end of file
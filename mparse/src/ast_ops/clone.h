@@ -6,4 +6,7 @@ namespace ast_ops {
 
 mparse::ast_node_ptr clone(const mparse::ast_node& node);
 
+// Copies `node` alone, sharing its children with the original.
+mparse::ast_node_ptr clone_node(const mparse::ast_node& node);
+
 } // namespace ast_ops
\ No newline at end of file
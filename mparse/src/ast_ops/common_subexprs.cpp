@@ -0,0 +1,163 @@
+#include "common_subexprs.h"
+
+#include "ast_ops/clone.h"
+#include "ast_ops/matching/compare.h"
+#include <cmath>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace ast_ops {
+namespace {
+
+// Literals -0 and 0 are kept apart, as they can evaluate differently.
+struct cse_comparer : matching::default_expr_comparer_base<cse_comparer> {
+  bool compare_literal(const mparse::literal_node& first,
+                       const mparse::literal_node& second) const {
+    return first.val() == second.val() &&
+           std::signbit(first.val()) == std::signbit(second.val());
+  }
+};
+
+// Canonical nodes of the subtrees seen so far, hash-consed: as the children of
+// nodes passed in have already been made canonical, nodes are equivalent
+// exactly when they compare equal locally and have the same children.
+class subexpr_table {
+public:
+  explicit subexpr_table(const func_purity& is_pure) : is_pure_(is_pure) {}
+
+  // Returns the node equivalent to `node` added earlier, or adds `node` if
+  // there is none. `hash` is the structural hash of `node`.
+  mparse::ast_node_ptr canonical(const mparse::ast_node_ptr& node,
+                                 std::size_t hash);
+
+private:
+  bool shareable(const mparse::ast_node& node) const;
+  static bool equivalent(const mparse::ast_node& first,
+                         const mparse::ast_node& second);
+
+  const func_purity& is_pure_;
+  std::unordered_multimap<std::size_t, mparse::ast_node_ptr> nodes_;
+};
+
+mparse::ast_node_ptr subexpr_table::canonical(const mparse::ast_node_ptr& node,
+                                              std::size_t hash) {
+  if (!shareable(*node)) {
+    return node;
+  }
+
+  auto [first, last] = nodes_.equal_range(hash);
+  for (auto it = first; it != last; ++it) {
+    if (equivalent(*it->second, *node)) {
+      return it->second;
+    }
+  }
+
+  nodes_.emplace(hash, node);
+  return node;
+}
+
+bool subexpr_table::shareable(const mparse::ast_node& node) const {
+  auto* func_node = mparse::ast_node_cast<const mparse::func_node>(&node);
+  return !func_node || is_pure_(func_node->name());
+}
+
+bool subexpr_table::equivalent(const mparse::ast_node& first,
+                               const mparse::ast_node& second) {
+  cse_comparer comp;
+  if (!matching::impl::compare_nodes(first, second, comp)) {
+    return false;
+  }
+
+  auto* first_bin = mparse::ast_node_cast<const mparse::binary_op_node>(&first);
+  if (first_bin && matching::is_commutative(first_bin->type())) {
+    auto* second_bin = static_cast<const mparse::binary_op_node*>(&second);
+    if (first_bin->lhs() == second_bin->rhs() &&
+        first_bin->rhs() == second_bin->lhs()) {
+      return true;
+    }
+  }
+
+  for (std::size_t i = 0; i < mparse::child_count(first); i++) {
+    if (mparse::get_child(first, i) != mparse::get_child(second, i)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace
+
+
+void eliminate_common_subexprs(mparse::ast_node_ptr& node,
+                               const func_purity& is_pure) {
+  auto hashes = matching::hash_subexprs(*node);
+  subexpr_table table(is_pure);
+
+  // canonical nodes for the nodes visited so far, as `node` may already share
+  // some subtrees
+  std::unordered_map<const mparse::ast_node*, mparse::ast_node_ptr> visited;
+
+  struct frame {
+    mparse::ast_node_ptr node;
+    bool unique; // whether only this tree refers to the node
+    std::size_t next_child;
+  };
+
+  // canonical children of the nodes on the stack
+  std::vector<mparse::ast_node_ptr> results;
+
+  bool root_unique = node.use_count() == 1;
+  std::vector<frame> stack;
+  stack.push_back({node, root_unique, 0});
+
+  // Post-order walk, in evaluation order, so that the first occurrence of a
+  // subtree is the one kept.
+  while (!stack.empty()) {
+    frame& top = stack.back();
+
+    if (top.next_child < mparse::child_count(*top.node)) {
+      const auto& child = mparse::get_child_slot(*top.node, top.next_child++);
+
+      if (auto it = visited.find(child.get()); it != visited.end()) {
+        results.push_back(it->second);
+        continue;
+      }
+
+      bool unique = top.unique && child.use_count() == 1;
+      stack.push_back({child, unique, 0});
+      continue;
+    }
+
+    frame cur = std::move(top);
+    stack.pop_back();
+
+    const mparse::ast_node* orig_node = cur.node.get();
+    std::size_t count = mparse::child_count(*cur.node);
+    auto first_child = results.end() - count;
+
+    bool changed = false;
+    for (std::size_t i = 0; i < count; i++) {
+      changed =
+          changed || mparse::get_child_slot(*cur.node, i) != first_child[i];
+    }
+
+    if (changed) {
+      if (!cur.unique) {
+        cur.node = clone_node(*cur.node);
+      }
+      for (std::size_t i = 0; i < count; i++) {
+        mparse::get_child_slot(*cur.node, i) = std::move(first_child[i]);
+      }
+    }
+    results.erase(first_child, results.end());
+
+    auto canonical = table.canonical(cur.node, hashes.at(orig_node));
+    visited.emplace(orig_node, canonical);
+    results.push_back(std::move(canonical));
+  }
+
+  node = std::move(results.back());
+}
+
+} // namespace ast_ops
\ No newline at end of file
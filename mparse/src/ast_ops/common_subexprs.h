@@ -0,0 +1,25 @@
+#pragma once
+
+#include "ast_ops/eval/builtins.h"
+#include "mparse/ast.h"
+#include <functional>
+#include <string_view>
+
+namespace ast_ops {
+
+// Whether calls to the function `name` have no side effects and always return
+// the same result for the same arguments.
+using func_purity = std::function<bool(std::string_view name)>;
+
+// Turns `node` into a DAG in which structurally identical subtrees, including
+// those differing only in the order of commutative operands, are a single
+// shared node. `eval` computes such nodes once per evaluation; the node kept is
+// the first occurrence in evaluation order, so errors are still attributed to
+// it.
+//
+// Subtrees calling functions that `is_pure` rejects are never merged. Nodes
+// that `node` shares with other trees are copied rather than modified.
+void eliminate_common_subexprs(mparse::ast_node_ptr& node,
+                               const func_purity& is_pure = is_builtin_func);
+
+} // namespace ast_ops
\ No newline at end of file
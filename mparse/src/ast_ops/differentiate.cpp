@@ -0,0 +1,311 @@
+#include "differentiate.h"
+
+#include "ast_ops/eval/builtins.h"
+#include "ast_ops/eval/eval_error.h"
+#include "ast_ops/matching/compare.h"
+#include "ast_ops/matching/rewrite.h"
+#include "ast_ops/simplify.h"
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using namespace ast_ops::matching::literals;
+
+namespace ast_ops {
+namespace {
+
+// Derivatives are built from rules in which `deriv(x)` stands for the
+// derivative of the operand `x`, filled in once the rule has been applied.
+constexpr std::string_view deriv_func_name = "$d";
+
+template <typename Inner>
+constexpr auto deriv(Inner inner) {
+  return func(deriv_func_name, inner);
+}
+
+// clang-format off
+
+constexpr matching::rewriter_list deriv_rewriters = {
+    deriv(abs(x)), func("re", func("conj", x) * deriv(x)) / abs(x),
+    deriv(-x), -deriv(x),
+
+    deriv(x + y), deriv(x) + deriv(y),
+    deriv(x - y), deriv(x) - deriv(y),
+    deriv(x * y), deriv(x) * y + x * deriv(y),
+    deriv(x / y), (deriv(x) * y - x * deriv(y)) / pow(y, 2_lit),
+
+    deriv(func("sin", x)), func("cos", x) * deriv(x),
+    deriv(func("cos", x)), -func("sin", x) * deriv(x),
+    deriv(func("tan", x)), deriv(x) / pow(func("cos", x), 2_lit),
+
+    deriv(func("arcsin", x)), deriv(x) / func("sqrt", 1_lit - pow(x, 2_lit)),
+    deriv(func("asin", x)), deriv(x) / func("sqrt", 1_lit - pow(x, 2_lit)),
+    deriv(func("arccos", x)), -deriv(x) / func("sqrt", 1_lit - pow(x, 2_lit)),
+    deriv(func("acos", x)), -deriv(x) / func("sqrt", 1_lit - pow(x, 2_lit)),
+    deriv(func("arctan", x)), deriv(x) / (1_lit + pow(x, 2_lit)),
+    deriv(func("atan", x)), deriv(x) / (1_lit + pow(x, 2_lit)),
+
+    deriv(func("sinh", x)), func("cosh", x) * deriv(x),
+    deriv(func("cosh", x)), func("sinh", x) * deriv(x),
+    deriv(func("tanh", x)), deriv(x) / pow(func("cosh", x), 2_lit),
+
+    deriv(func("arcsinh", x)), deriv(x) / func("sqrt", pow(x, 2_lit) + 1_lit),
+    deriv(func("asinh", x)), deriv(x) / func("sqrt", pow(x, 2_lit) + 1_lit),
+    deriv(func("arccosh", x)),
+        deriv(x) / (func("sqrt", x - 1_lit) * func("sqrt", x + 1_lit)),
+    deriv(func("acosh", x)),
+        deriv(x) / (func("sqrt", x - 1_lit) * func("sqrt", x + 1_lit)),
+    deriv(func("arctanh", x)), deriv(x) / (1_lit - pow(x, 2_lit)),
+    deriv(func("atanh", x)), deriv(x) / (1_lit - pow(x, 2_lit)),
+
+    deriv(func("exp", x)), func("exp", x) * deriv(x),
+    deriv(func("ln", x)), deriv(x) / x,
+    deriv(func("log", x, y)),
+        (deriv(y) / y - func("log", x, y) * deriv(x) / x) / func("ln", x),
+
+    deriv(func("sqrt", x)), deriv(x) / (2_lit * func("sqrt", x)),
+    deriv(func("cbrt", x)), deriv(x) / (3_lit * pow(func("cbrt", x), 2_lit)),
+    deriv(func("nroot", x, y)),
+        func("nroot", x, y) * (deriv(y) / (x * y) -
+                               func("ln", abs(y)) * deriv(x) / pow(x, 2_lit)),
+
+    deriv(func("re", x)), func("re", deriv(x)),
+    deriv(func("real", x)), func("re", deriv(x)),
+    deriv(func("im", x)), func("im", deriv(x)),
+    deriv(func("imag", x)), func("im", deriv(x)),
+    deriv(func("arg", x)), func("im", deriv(x) / x),
+    deriv(func("conj", x)), func("conj", deriv(x)),
+
+    deriv(func("floor", any)), 0_lit,
+    deriv(func("ceil", any)), 0_lit,
+    deriv(func("round", any)), 0_lit,
+
+    deriv(func("mod", x, y)), deriv(x) - (x - func("mod", x, y)) / y * deriv(y),
+
+    // last, as they leave the derivative of the operand to be filled in
+    deriv(paren(x)), deriv(x),
+    deriv(+x), deriv(x)
+};
+
+// Powers are differentiated according to which of their operands vary, which
+// keeps the logarithm of the base out of the derivative where it isn't needed.
+
+constexpr matching::rewriter_list pow_base_rewriters = {
+    deriv(pow(x, y)), y * pow(x, y - 1_lit) * deriv(x)
+};
+
+constexpr matching::rewriter_list pow_exp_rewriters = {
+    deriv(pow(x, y)), pow(x, y) * func("ln", x) * deriv(y)
+};
+
+constexpr matching::rewriter_list pow_rewriters = {
+    deriv(pow(x, y)),
+        pow(x, y) * (deriv(y) * func("ln", x) + y * deriv(x) / x)
+};
+
+// clang-format on
+
+
+class differentiator {
+public:
+  explicit differentiator(std::string_view var) : var_(var) {}
+
+  // Differentiates the subtree held by `slot`, whose children have already
+  // been differentiated.
+  void differentiate_node(const mparse::ast_node_ptr& slot);
+
+  mparse::ast_node_ptr result_for(const mparse::ast_node* node) const;
+
+private:
+  mparse::ast_node_ptr apply_rules(const mparse::ast_node_ptr& slot) const;
+  void fill_derivs(mparse::ast_node_ptr& node) const;
+
+  std::string_view var_;
+
+  // Derivatives of the nodes differentiated so far, null where they are zero.
+  std::unordered_map<const mparse::ast_node*, mparse::ast_node_ptr> derivs_;
+};
+
+void differentiator::differentiate_node(const mparse::ast_node_ptr& slot) {
+  const mparse::ast_node* node = slot.get();
+  mparse::ast_node_ptr& ret = derivs_[node];
+
+  if (auto* id_node = mparse::ast_node_cast<const mparse::id_node>(node)) {
+    if (id_node->name() == var_) {
+      ret = mparse::make_ast_node<mparse::literal_node>(1);
+    }
+    return;
+  }
+
+  bool varies = false;
+  for (std::size_t i = 0; i < mparse::child_count(*node); i++) {
+    varies = varies || derivs_.at(mparse::get_child(*node, i));
+  }
+
+  if (varies) {
+    ret = apply_rules(slot);
+    fill_derivs(ret);
+  }
+}
+
+mparse::ast_node_ptr differentiator::result_for(
+    const mparse::ast_node* node) const {
+  if (auto& ret = derivs_.at(node)) {
+    return ret;
+  }
+  return mparse::make_ast_node<mparse::literal_node>(0);
+}
+
+mparse::ast_node_ptr differentiator::apply_rules(
+    const mparse::ast_node_ptr& slot) const {
+  if (auto* func_node =
+          mparse::ast_node_cast<const mparse::func_node>(slot.get())) {
+    if (func_node->name() == "avg") {
+      // linear in all of its arguments
+      mparse::func_node::arg_list args;
+      for (const auto& arg : func_node->args()) {
+        args.push_back(result_for(arg.get()));
+      }
+      return mparse::make_ast_node<mparse::func_node>("avg", std::move(args));
+    }
+  }
+
+  mparse::ast_node_ptr ret = mparse::make_ast_node<mparse::func_node>(
+      std::string(deriv_func_name), mparse::func_node::arg_list{slot});
+
+  if (auto* pow_node = mparse::ast_node_cast<const mparse::binary_op_node>(
+          slot.get());
+      pow_node && pow_node->type() == mparse::binary_op_type::pow) {
+    bool base_varies = derivs_.at(pow_node->lhs()) != nullptr;
+    bool exp_varies = derivs_.at(pow_node->rhs()) != nullptr;
+
+    if (!exp_varies) {
+      matching::apply_rewriters(ret, pow_base_rewriters);
+    } else if (!base_varies) {
+      matching::apply_rewriters(ret, pow_exp_rewriters);
+    } else {
+      matching::apply_rewriters(ret, pow_rewriters);
+    }
+    return ret;
+  }
+
+  if (!matching::apply_rewriters(ret, deriv_rewriters)) {
+    auto* func_node = static_cast<const mparse::func_node*>(slot.get());
+    throw diff_error("Function '" + func_node->name() +
+                     "' cannot be differentiated");
+  }
+  return ret;
+}
+
+void differentiator::fill_derivs(mparse::ast_node_ptr& node) const {
+  // Only the nodes built by the rule are searched; the operands it refers to
+  // are shared with the original tree.
+  std::vector<mparse::ast_node_ptr*> pending = {&node};
+
+  while (!pending.empty()) {
+    mparse::ast_node_ptr& cur_node = *pending.back();
+    pending.pop_back();
+
+    if (cur_node.use_count() > 1) {
+      continue;
+    }
+
+    auto* func_node = mparse::ast_node_cast<mparse::func_node>(cur_node.get());
+    if (func_node && func_node->name() == deriv_func_name) {
+      cur_node = result_for(func_node->args()[0].get());
+      continue;
+    }
+
+    for (std::size_t i = 0; i < mparse::child_count(*cur_node); i++) {
+      pending.push_back(&mparse::get_child_slot(*cur_node, i));
+    }
+  }
+}
+
+
+// Replaces subtrees of `node` equivalent to some subtree of `source` with that
+// subtree.
+void share_subexprs(mparse::ast_node_ptr& node,
+                    const mparse::ast_node_ptr& source) {
+  auto source_hashes = matching::hash_subexprs(*source);
+
+  std::unordered_multimap<std::size_t, mparse::ast_node_ptr> source_nodes;
+  std::vector<mparse::ast_node_ptr> pending_source = {source};
+
+  while (!pending_source.empty()) {
+    mparse::ast_node_ptr cur_node = std::move(pending_source.back());
+    pending_source.pop_back();
+
+    for (std::size_t i = 0; i < mparse::child_count(*cur_node); i++) {
+      pending_source.push_back(mparse::get_child_slot(*cur_node, i));
+    }
+    source_nodes.emplace(source_hashes.at(cur_node.get()), std::move(cur_node));
+  }
+
+  auto hashes = matching::hash_subexprs(*node);
+  std::vector<mparse::ast_node_ptr*> pending = {&node};
+
+  while (!pending.empty()) {
+    mparse::ast_node_ptr& cur_node = *pending.back();
+    pending.pop_back();
+
+    auto [first, last] = source_nodes.equal_range(hashes.at(cur_node.get()));
+    auto it = std::find_if(first, last, [&](const auto& entry) {
+      return matching::compare_exprs(*entry.second, *cur_node);
+    });
+
+    if (it != last) {
+      cur_node = it->second;
+      continue;
+    }
+
+    for (std::size_t i = 0; i < mparse::child_count(*cur_node); i++) {
+      pending.push_back(&mparse::get_child_slot(*cur_node, i));
+    }
+  }
+}
+
+} // namespace
+
+
+mparse::ast_node_ptr differentiate(const mparse::ast_node_ptr& node,
+                                   std::string_view var) {
+  differentiator diff(var);
+
+  // post-order walk over the slots holding the nodes, so that rules can share
+  // the operands they refer to
+  struct frame {
+    const mparse::ast_node_ptr* slot;
+    std::size_t next_child;
+  };
+
+  std::vector<frame> stack = {{&node, 0}};
+
+  while (!stack.empty()) {
+    frame& top = stack.back();
+    mparse::ast_node& cur_node = **top.slot;
+
+    if (top.next_child < mparse::child_count(cur_node)) {
+      stack.push_back({&mparse::get_child_slot(cur_node, top.next_child++), 0});
+      continue;
+    }
+
+    diff.differentiate_node(*top.slot);
+    stack.pop_back();
+  }
+
+  mparse::ast_node_ptr ret = diff.result_for(node.get());
+  try {
+    simplify(ret, {}, builtin_func_scope());
+  } catch (const eval_error& err) {
+    // The error refers to a node of the discarded derivative, so only its
+    // message is kept.
+    throw diff_error(std::string("Derivative is undefined: ") + err.what());
+  }
+  share_subexprs(ret, node);
+  return ret;
+}
+
+} // namespace ast_ops
\ No newline at end of file
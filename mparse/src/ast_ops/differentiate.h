@@ -0,0 +1,28 @@
+#pragma once
+
+#include "mparse/ast.h"
+#include <stdexcept>
+#include <string_view>
+
+namespace ast_ops {
+
+class diff_error : public std::runtime_error {
+public:
+  using runtime_error::runtime_error;
+};
+
+// Returns the simplified derivative of `node` with respect to the variable
+// `var`, taken along real changes of `var` like `eval_forward_diff`.
+//
+// Subtrees of the derivative equivalent to subtrees of `node` are shared with
+// it rather than copied, so that `eval_all` evaluates them only once when
+// computing both. Simplifying `node` first usually increases the sharing.
+//
+// Throws `diff_error` if `node` calls a function that cannot be differentiated
+// symbolically (such as `min` or a user-defined function) with arguments
+// depending on `var`, or if the derivative has a constant part that cannot be
+// evaluated, as for `x / 0`.
+mparse::ast_node_ptr differentiate(const mparse::ast_node_ptr& node,
+                                   std::string_view var);
+
+} // namespace ast_ops
\ No newline at end of file
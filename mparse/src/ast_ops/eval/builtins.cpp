@@ -14,14 +14,21 @@ namespace {
 
 constexpr auto domain_err_msg = "argument out of domain"sv;
 
+func_result arg_error(std::string_view what,
+                      std::vector<std::size_t> indices) {
+  return util::unexpected(func_error::arg(what, std::move(indices)));
+}
+
+func_result domain_error(std::vector<std::size_t> indices = {0}) {
+  return arg_error(domain_err_msg, std::move(indices));
+}
+
 template <typename F>
-auto check_domain(F func) {
+func_result check_domain(F func) {
   errno = 0;
-  auto ret = func();
-  if (errno) {
-    if (errno == EDOM) {
-      throw func_arg_error(domain_err_msg, {0});
-    }
+  number ret = func();
+  if (errno == EDOM) {
+    return domain_error();
   }
   return ret;
 }
@@ -29,97 +36,97 @@ auto check_domain(F func) {
 } // namespace
 
 
-number sin(number x) {
+func_result sin(number x) {
   return check_domain([&] { return std::sin(x); });
 }
 
-number cos(number x) {
+func_result cos(number x) {
   return check_domain([&] { return std::cos(x); });
 }
 
-number tan(number x) {
+func_result tan(number x) {
   return check_domain([&] { return std::tan(x); });
 }
 
 
-number asin(number x) {
+func_result asin(number x) {
   return check_domain([&] { return std::asin(x); });
 }
 
-number acos(number x) {
+func_result acos(number x) {
   return check_domain([&] { return std::acos(x); });
 }
 
-number atan(number x) {
+func_result atan(number x) {
   return check_domain([&] { return std::atan(x); });
 }
 
 
-number sinh(number x) {
+func_result sinh(number x) {
   return check_domain([&] { return std::sinh(x); });
 }
 
-number cosh(number x) {
+func_result cosh(number x) {
   return check_domain([&] { return std::cosh(x); });
 }
 
-number tanh(number x) {
+func_result tanh(number x) {
   return check_domain([&] { return std::tanh(x); });
 }
 
 
-number asinh(number x) {
+func_result asinh(number x) {
   return check_domain([&] { return std::asinh(x); });
 }
 
-number acosh(number x) {
+func_result acosh(number x) {
   return check_domain([&] { return std::acosh(x); });
 }
 
-number atanh(number x) {
+func_result atanh(number x) {
   return check_domain([&] { return std::atanh(x); });
 }
 
 
-number exp(number x) {
+func_result exp(number x) {
   return check_domain([&] { return std::exp(x); });
 }
 
-number ln(number x) {
+func_result ln(number x) {
   if (x == 0.0) {
-    throw func_arg_error(domain_err_msg, {0});
+    return domain_error();
   }
   return check_domain([&] { return std::log(x); });
 }
 
-number log(number base, number val) {
+func_result log(number base, number val) {
   if (val == 0.0) {
-    throw func_arg_error(domain_err_msg, {1});
+    return domain_error({1});
   }
   if (base == 0.0 || base == 1.0) {
-    throw func_arg_error("base out of domain", {0});
+    return arg_error("base out of domain", {0});
   }
   return std::log(val) / std::log(base);
 }
 
 
-number sqrt(number x) {
+func_result sqrt(number x) {
   return check_domain([&] { return std::sqrt(x); });
 }
 
-double cbrt(double x) {
+func_result cbrt(double x) {
   return check_domain([&] { return std::cbrt(x); });
 }
 
-double nroot(double n, double val) {
+func_result nroot(double n, double val) {
   if (val < 0 && std::fmod(n, 2) != 1) {
-    throw func_arg_error("taking non-odd nth-root of negative number", {0, 1});
+    return arg_error("taking non-odd nth-root of negative number", {0, 1});
   }
   if (n == 0) {
-    throw func_arg_error("taking zero-th root of number", {0});
+    return arg_error("taking zero-th root of number", {0});
   }
   if (val == 0 && n < 0) {
-    throw func_arg_error("taking negative root of zero", {0, 1});
+    return arg_error("taking negative root of zero", {0, 1});
   }
 
   if (val < 0) {
@@ -137,7 +144,7 @@ double im(number x) {
   return x.imag();
 }
 
-double arg(number x) {
+func_result arg(number x) {
   return check_domain([&] { return std::arg(x); });
 }
 
@@ -146,44 +153,47 @@ number conj(number x) {
 }
 
 
-double floor(double x) {
+func_result floor(double x) {
   return check_domain([&] { return std::floor(x); });
 }
 
-double ceil(double x) {
+func_result ceil(double x) {
   return check_domain([&] { return std::ceil(x); });
 }
 
-double round(double x) {
+func_result round(double x) {
   return check_domain([&] { return std::round(x); });
 }
 
 
-double mod(double a, double b) {
+func_result mod(double a, double b) {
   if (b == 0) {
-    throw func_arg_error("mod by zero", {1});
+    return arg_error("mod by zero", {1});
   }
   return std::fmod(a, b);
 }
 
 
-double min(real_func_args vals) {
+func_result min(real_func_args vals) {
   if (vals.empty()) {
-    throw arity_error("at least one argument is required", 1, 0);
+    return util::unexpected(
+        func_error::arity(1, 0, "at least one argument is required"));
   }
   return *std::min_element(vals.begin(), vals.end());
 }
 
-double max(real_func_args vals) {
+func_result max(real_func_args vals) {
   if (vals.empty()) {
-    throw arity_error("at least one argument is required", 1, 0);
+    return util::unexpected(
+        func_error::arity(1, 0, "at least one argument is required"));
   }
   return *std::max_element(vals.begin(), vals.end());
 }
 
-number avg(func_args vals) {
+func_result avg(func_args vals) {
   if (vals.empty()) {
-    throw arity_error("at least one argument is required", 1, 0);
+    return util::unexpected(
+        func_error::arity(1, 0, "at least one argument is required"));
   }
   return std::accumulate(vals.begin(), vals.end(), 0i) /
          static_cast<double>(vals.size());
@@ -192,68 +202,46 @@ number avg(func_args vals) {
 } // namespace builtins
 
 
-var_scope builtin_var_scope() {
-  return {
-      {"e", builtins::e},
-      {"pi", builtins::pi},
-      {"tau", builtins::tau},
-      {"i", builtins::i},
-  };
-}
-
-func_scope builtin_func_scope() {
-  // clang-format off
-
-  return {
-      {"sin", builtins::sin},
-      {"cos", builtins::cos},
-      {"tan", builtins::tan},
-
-      {"arcsin", builtins::asin},
-      {"asin", builtins::asin},
-      {"arccos", builtins::acos},
-      {"acos", builtins::acos},
-      {"arctan", builtins::atan},
-      {"atan", builtins::atan},
-
-      {"sinh", builtins::sinh},
-      {"cosh", builtins::cosh},
-      {"tanh", builtins::tanh},
-
-      {"arcsinh", builtins::asinh},
-      {"asinh", builtins::asinh},
-      {"arccosh", builtins::acosh},
-      {"acosh", builtins::acosh},
-      {"arctanh", builtins::atanh},
-      {"atanh", builtins::atanh},
-
-      {"exp", builtins::exp},
-      {"ln", builtins::ln},
-      {"log", builtins::log},
-
-      {"sqrt", builtins::sqrt},
-      {"cbrt", builtins::cbrt},
-      {"nroot", builtins::nroot},
-
-      {"re", builtins::re},
-      {"real", builtins::re},
-      {"im", builtins::im},
-      {"imag", builtins::im},
-      {"arg", builtins::arg},
-      {"conj", builtins::conj},
-
-      {"floor", builtins::floor},
-      {"ceil", builtins::ceil},
-      {"round", builtins::round},
-
-      {"mod", builtins::mod},
-
-      {"min", builtins::min},
-      {"max", builtins::max},
-      {"avg", builtins::avg},
-  };
-
-  // clang-format on
+namespace {
+
+constexpr auto builtin_var_bindings = std::apply(
+    [](const auto&... vars) {
+      return std::array{var_scope::binding(vars.val)...};
+    },
+    builtin_vars);
+
+const var_scope::binding* lookup_builtin_var(std::string_view name) {
+  std::size_t idx = builtin_var_names.find(name);
+  return idx < builtin_var_bindings.size() ? &builtin_var_bindings[idx]
+                                           : nullptr;
+}
+
+const func_scope::func_wrapper* lookup_builtin_func(std::string_view name) {
+  static const auto wrappers = std::apply(
+      [](const auto&... funcs) {
+        return std::array{func_scope::func_wrapper(funcs.func)...};
+      },
+      builtin_funcs);
+
+  std::size_t idx = builtin_func_names.find(name);
+  return idx < wrappers.size() ? &wrappers[idx] : nullptr;
+}
+
+} // namespace
+
+
+const var_scope& builtin_var_scope() {
+  static const var_scope vscope(lookup_builtin_var);
+  return vscope;
+}
+
+const func_scope& builtin_func_scope() {
+  static const func_scope fscope(lookup_builtin_func);
+  return fscope;
+}
+
+bool is_builtin_func(std::string_view name) {
+  return builtin_func_names.find(name) < builtin_func_names.size();
 }
 
 } // namespace ast_ops
\ No newline at end of file
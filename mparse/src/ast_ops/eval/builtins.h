@@ -1,7 +1,12 @@
 #pragma once
 
+#include "ast_ops/eval/func_util.h"
 #include "ast_ops/eval/scope.h"
 #include "ast_ops/eval/types.h"
+#include "util/perfect_hash.h"
+#include <array>
+#include <string_view>
+#include <tuple>
 #include <vector>
 
 namespace ast_ops {
@@ -13,48 +18,143 @@ constexpr auto tau = 6.283185307179586;
 constexpr auto i = number(0, 1);
 
 
-number sin(number x);
-number cos(number x);
-number tan(number x);
+// Functions that can fail report it in their result rather than throwing.
 
-number asin(number x);
-number acos(number x);
-number atan(number x);
+func_result sin(number x);
+func_result cos(number x);
+func_result tan(number x);
 
-number sinh(number x);
-number cosh(number x);
-number tanh(number x);
+func_result asin(number x);
+func_result acos(number x);
+func_result atan(number x);
 
-number asinh(number x);
-number acosh(number x);
-number atanh(number x);
+func_result sinh(number x);
+func_result cosh(number x);
+func_result tanh(number x);
 
-number exp(number x);
-number ln(number x);
-number log(number base, number val);
+func_result asinh(number x);
+func_result acosh(number x);
+func_result atanh(number x);
 
-number sqrt(number x);
-double cbrt(double x);
-double nroot(double n, double val);
+func_result exp(number x);
+func_result ln(number x);
+func_result log(number base, number val);
+
+func_result sqrt(number x);
+func_result cbrt(double x);
+func_result nroot(double n, double val);
 
 double re(number x);
 double im(number x);
-double arg(number x);
+func_result arg(number x);
 number conj(number x);
 
-double floor(double x);
-double ceil(double x);
-double round(double x);
+func_result floor(double x);
+func_result ceil(double x);
+func_result round(double x);
 
-double mod(double a, double b);
+func_result mod(double a, double b);
 
-double min(real_func_args vals);
-double max(real_func_args vals);
-number avg(func_args vals);
+func_result min(real_func_args vals);
+func_result max(real_func_args vals);
+func_result avg(func_args vals);
 
 } // namespace builtins
 
-var_scope builtin_var_scope();
-func_scope builtin_func_scope();
+
+struct builtin_var {
+  std::string_view name;
+  number val;
+};
+
+template <typename F>
+struct builtin_func {
+  std::string_view name;
+  F* func;
+};
+
+// Tables of all builtins, usable at compile time.
+
+constexpr std::array builtin_vars = {
+    builtin_var{"e", builtins::e},
+    builtin_var{"pi", builtins::pi},
+    builtin_var{"tau", builtins::tau},
+    builtin_var{"i", builtins::i},
+};
+
+// clang-format off
+
+constexpr std::tuple builtin_funcs(
+    builtin_func{"sin", builtins::sin},
+    builtin_func{"cos", builtins::cos},
+    builtin_func{"tan", builtins::tan},
+
+    builtin_func{"arcsin", builtins::asin},
+    builtin_func{"asin", builtins::asin},
+    builtin_func{"arccos", builtins::acos},
+    builtin_func{"acos", builtins::acos},
+    builtin_func{"arctan", builtins::atan},
+    builtin_func{"atan", builtins::atan},
+
+    builtin_func{"sinh", builtins::sinh},
+    builtin_func{"cosh", builtins::cosh},
+    builtin_func{"tanh", builtins::tanh},
+
+    builtin_func{"arcsinh", builtins::asinh},
+    builtin_func{"asinh", builtins::asinh},
+    builtin_func{"arccosh", builtins::acosh},
+    builtin_func{"acosh", builtins::acosh},
+    builtin_func{"arctanh", builtins::atanh},
+    builtin_func{"atanh", builtins::atanh},
+
+    builtin_func{"exp", builtins::exp},
+    builtin_func{"ln", builtins::ln},
+    builtin_func{"log", builtins::log},
+
+    builtin_func{"sqrt", builtins::sqrt},
+    builtin_func{"cbrt", builtins::cbrt},
+    builtin_func{"nroot", builtins::nroot},
+
+    builtin_func{"re", builtins::re},
+    builtin_func{"real", builtins::re},
+    builtin_func{"im", builtins::im},
+    builtin_func{"imag", builtins::im},
+    builtin_func{"arg", builtins::arg},
+    builtin_func{"conj", builtins::conj},
+
+    builtin_func{"floor", builtins::floor},
+    builtin_func{"ceil", builtins::ceil},
+    builtin_func{"round", builtins::round},
+
+    builtin_func{"mod", builtins::mod},
+
+    builtin_func{"min", builtins::min},
+    builtin_func{"max", builtins::max},
+    builtin_func{"avg", builtins::avg}
+);
+
+// clang-format on
+
+// Indices of the builtins in the tables above, by name.
+
+constexpr util::perfect_hash builtin_var_names = std::apply(
+    [](const auto&... vars) {
+      return util::perfect_hash(std::array{vars.name...});
+    },
+    builtin_vars);
+
+constexpr util::perfect_hash builtin_func_names = std::apply(
+    [](const auto&... funcs) {
+      return util::perfect_hash(std::array{funcs.name...});
+    },
+    builtin_funcs);
+
+
+// Immutable scopes holding the builtins, created once and safe to share
+// between threads. User scopes should chain to them rather than copy them.
+const var_scope& builtin_var_scope();
+const func_scope& builtin_func_scope();
+
+bool is_builtin_func(std::string_view name);
 
 } // namespace ast_ops
\ No newline at end of file
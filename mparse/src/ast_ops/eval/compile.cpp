@@ -0,0 +1,732 @@
+#include "compile.h"
+
+#include "ast_ops/eval/builtins.h"
+#include "ast_ops/eval/eval.h"
+#include "ast_ops/eval/eval_error.h"
+#include "ast_ops/eval/eval_ops.h"
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+
+namespace ast_ops {
+namespace {
+
+constexpr int max_powi_exponent = 64;
+constexpr int max_poly_degree = 32;
+
+// sums with more terms are not considered polynomials; as matching gives up
+// once it has seen that many sums or terms, this also bounds the work spent
+// looking for them in any sum
+constexpr std::size_t max_poly_terms = 64;
+
+
+const mparse::ast_node* strip_parens(const mparse::ast_node* node) {
+  while (auto* paren = mparse::ast_node_cast<const mparse::paren_node>(node)) {
+    node = paren->child();
+  }
+  return node;
+}
+
+// Value of `node` if it is a finite literal, possibly parenthesized or signed.
+std::optional<double> constant_value(const mparse::ast_node* node) {
+  double sign = 1;
+
+  while (true) {
+    node = strip_parens(node);
+
+    if (auto* unary =
+            mparse::ast_node_cast<const mparse::unary_op_node>(node)) {
+      if (unary->type() == mparse::unary_op_type::neg) {
+        sign = -sign;
+      }
+      node = unary->child();
+      continue;
+    }
+
+    if (auto* lit = mparse::ast_node_cast<const mparse::literal_node>(node)) {
+      if (std::isfinite(lit->val())) {
+        return sign * lit->val();
+      }
+    }
+    return std::nullopt;
+  }
+}
+
+std::optional<int> int_value(double val, int max) {
+  if (val != std::floor(val) || std::abs(val) > max) {
+    return std::nullopt;
+  }
+  return static_cast<int>(val);
+}
+
+// Whether `x * (1 / val)` is always equal to `x / val`.
+bool has_exact_reciprocal(double val) {
+  int exp;
+  double mant = std::frexp(val, &exp);
+  return std::abs(mant) == 0.5 && std::isnormal(val) && std::isnormal(1 / val);
+}
+
+number powi(number base, int exp) {
+  bool invert = exp < 0;
+  unsigned n = invert ? -exp : exp;
+
+  number ret = 1;
+  while (n) {
+    if (n & 1) {
+      ret *= base;
+    }
+    n >>= 1;
+    if (n) {
+      base *= base;
+    }
+  }
+
+  return invert ? 1.0 / ret : ret;
+}
+
+// `eval` reports powers that underflow as out of range, so lowered powers
+// whose results may have underflowed are recomputed as written.
+bool may_have_underflowed(number res) {
+  return res == 0.0 || std::fpclassify(res.real()) == FP_SUBNORMAL ||
+         std::fpclassify(res.imag()) == FP_SUBNORMAL;
+}
+
+
+// Polynomials are recognized as sums of terms `c`, `x`, `x^k`, `c * x` and
+// `c * x^k` (in either order), possibly negated, where `x` is a single
+// variable and `c` and `k` are constants.
+class poly_matcher {
+public:
+  // Returns the coefficients of `node`, lowest degree first, if it is a
+  // polynomial worth evaluating in Horner form.
+  std::optional<std::vector<double>> match(const mparse::ast_node& node);
+
+  std::string_view var() const { return var_; }
+
+private:
+  bool add_term(const mparse::ast_node* node, double sign);
+  std::optional<int> match_monomial(const mparse::ast_node* node);
+
+  std::string_view var_;
+  std::vector<double> coeffs_;
+};
+
+std::optional<std::vector<double>> poly_matcher::match(
+    const mparse::ast_node& node) {
+  var_ = {};
+  coeffs_.clear();
+
+  std::vector<std::pair<const mparse::ast_node*, double>> pending = {
+      {&node, 1}};
+  std::size_t sum_count = 0;
+  std::size_t term_count = 0;
+
+  while (!pending.empty()) {
+    auto [cur, sign] = pending.back();
+    pending.pop_back();
+    cur = strip_parens(cur);
+
+    auto* bin = mparse::ast_node_cast<const mparse::binary_op_node>(cur);
+    if (bin && (bin->type() == mparse::binary_op_type::add ||
+                bin->type() == mparse::binary_op_type::sub)) {
+      if (++sum_count >= max_poly_terms) {
+        return std::nullopt; // more terms than that
+      }
+
+      double rhs_sign =
+          bin->type() == mparse::binary_op_type::sub ? -sign : sign;
+      pending.emplace_back(bin->rhs(), rhs_sign);
+      pending.emplace_back(bin->lhs(), sign);
+      continue;
+    }
+
+    if (++term_count > max_poly_terms || !add_term(cur, sign)) {
+      return std::nullopt;
+    }
+  }
+
+  if (term_count < 2 || coeffs_.size() <= 2) {
+    return std::nullopt;
+  }
+  return std::move(coeffs_);
+}
+
+bool poly_matcher::add_term(const mparse::ast_node* node, double sign) {
+  node = strip_parens(node);
+
+  while (auto* unary =
+             mparse::ast_node_cast<const mparse::unary_op_node>(node)) {
+    if (unary->type() == mparse::unary_op_type::neg) {
+      sign = -sign;
+    }
+    node = strip_parens(unary->child());
+  }
+
+  double coeff = 1;
+  std::optional<int> degree = 0;
+
+  if (auto val = constant_value(node)) {
+    coeff = *val;
+  } else if (auto* bin =
+                 mparse::ast_node_cast<const mparse::binary_op_node>(node);
+             bin && bin->type() == mparse::binary_op_type::mult) {
+    if (auto val = constant_value(bin->lhs())) {
+      coeff = *val;
+      degree = match_monomial(bin->rhs());
+    } else if (auto val = constant_value(bin->rhs())) {
+      coeff = *val;
+      degree = match_monomial(bin->lhs());
+    } else {
+      return false;
+    }
+  } else {
+    degree = match_monomial(node);
+  }
+
+  if (!degree) {
+    return false;
+  }
+
+  if (coeffs_.size() <= static_cast<std::size_t>(*degree)) {
+    coeffs_.resize(*degree + 1);
+  }
+  coeffs_[*degree] += sign * coeff;
+  return true;
+}
+
+std::optional<int> poly_matcher::match_monomial(const mparse::ast_node* node) {
+  node = strip_parens(node);
+  int degree = 1;
+
+  if (auto* bin = mparse::ast_node_cast<const mparse::binary_op_node>(node);
+      bin && bin->type() == mparse::binary_op_type::pow) {
+    auto exp = constant_value(bin->rhs());
+    auto int_exp = exp ? int_value(*exp, max_poly_degree) : std::nullopt;
+    if (!int_exp || *int_exp < 1) {
+      return std::nullopt;
+    }
+
+    degree = *int_exp;
+    node = strip_parens(bin->lhs());
+  }
+
+  auto* id = mparse::ast_node_cast<const mparse::id_node>(node);
+  if (!id || (!var_.empty() && id->name() != var_)) {
+    return std::nullopt;
+  }
+
+  var_ = id->name();
+  return degree;
+}
+
+} // namespace
+
+
+class compiled_expr::compiler {
+public:
+  explicit compiler(compiled_expr& expr) : expr_(expr) {}
+
+  // Computes every subtree of `root` that depends only on the variables in
+  // `known` and builtin functions, for `compile` to replace by its value (or
+  // by the error computing it raised).
+  void fold_constants(const mparse::ast_node& root, const var_scope& known);
+
+  void compile(const mparse::ast_node& root);
+
+private:
+  struct frame {
+    const mparse::ast_node* node;
+    bool shared;
+    std::size_t next_child;
+    std::size_t child_count; // children that are compiled
+    entry lowered;           // replaces the node's own operation
+  };
+
+  void push(const mparse::ast_node& node, bool shared);
+  void leave(const frame& fr);
+
+  std::optional<number> fold(const mparse::ast_node& node,
+                             const var_scope& known,
+                             const func_scope& builtins);
+
+  std::optional<entry> lower(const mparse::ast_node& node);
+  std::optional<entry> lower_binary(const mparse::binary_op_node& node);
+  std::optional<double> real_constant(const mparse::ast_node* node) const;
+
+  std::size_t var_slot(std::string_view name);
+
+  void add_entry(entry ent, std::size_t operand_count);
+
+  compiled_expr& expr_;
+  poly_matcher poly_matcher_;
+
+  std::vector<frame> stack_;
+
+  // entries whose results have not been used yet
+  std::vector<std::uint32_t> pending_;
+
+  // function slots of the `func_node`s currently being compiled
+  std::vector<std::size_t> func_slots_;
+
+  std::unordered_map<std::string_view, std::size_t> var_slots_;
+
+  // entries computing shared subtrees compiled so far
+  std::unordered_map<const mparse::ast_node*, std::uint32_t> shared_entries_;
+
+  const var_scope* known_ = nullptr;
+
+  // values of the subtrees found by `fold_constants`, and errors raised by
+  // those that could not be computed
+  std::unordered_map<const mparse::ast_node*, number> folded_;
+  std::unordered_map<const mparse::ast_node*, std::exception_ptr> fold_errors_;
+};
+
+void compiled_expr::compiler::fold_constants(const mparse::ast_node& root,
+                                             const var_scope& known) {
+  known_ = &known;
+  const func_scope& builtins = builtin_func_scope();
+
+  struct frame {
+    const mparse::ast_node* node;
+    std::size_t next_child;
+  };
+
+  std::vector<frame> stack = {{&root, 0}};
+  std::unordered_set<const mparse::ast_node*> visited_shared;
+
+  while (!stack.empty()) {
+    frame& top = stack.back();
+
+    if (top.next_child < mparse::child_count(*top.node)) {
+      const auto& child = mparse::get_child_slot(*top.node, top.next_child++);
+      if (child.use_count() == 1 || visited_shared.insert(child.get()).second) {
+        stack.push_back({child.get(), 0});
+      }
+      continue;
+    }
+
+    const mparse::ast_node& node = *top.node;
+    stack.pop_back();
+
+    if (auto val = fold(node, known, builtins)) {
+      folded_.emplace(&node, *val);
+    }
+  }
+}
+
+// Computes `node` from the folded values of its children, if it can be.
+std::optional<number> compiled_expr::compiler::fold(
+    const mparse::ast_node& node, const var_scope& known,
+    const func_scope& builtins) {
+  std::vector<number> operands;
+  for (std::size_t i = 0; i < mparse::child_count(node); i++) {
+    auto it = folded_.find(mparse::get_child(node, i));
+    if (it == folded_.end()) {
+      return std::nullopt;
+    }
+    operands.push_back(it->second);
+  }
+
+  try {
+    if (mparse::ast_node_cast<const mparse::paren_node>(&node)) {
+      return operands[0];
+    }
+    if (mparse::ast_node_cast<const mparse::abs_node>(&node)) {
+      return impl::eval_abs(operands[0], &node);
+    }
+    if (auto* unary =
+            mparse::ast_node_cast<const mparse::unary_op_node>(&node)) {
+      return impl::eval_unary_op(unary->type(), operands[0], &node);
+    }
+    if (auto* bin =
+            mparse::ast_node_cast<const mparse::binary_op_node>(&node)) {
+      return impl::eval_binary_op(bin->type(), operands[0], operands[1],
+                                  &node);
+    }
+    if (auto* func_node =
+            mparse::ast_node_cast<const mparse::func_node>(&node)) {
+      if (!is_builtin_func(func_node->name())) {
+        return std::nullopt;
+      }
+
+      const function& func =
+          impl::lookup_func(builtins, func_node->name(), &node);
+      return impl::call_func([&] { return func(operands); },
+                             func_node->name(), &node);
+    }
+    if (auto* lit = mparse::ast_node_cast<const mparse::literal_node>(&node)) {
+      return impl::eval_literal(lit->val(), &node);
+    }
+    if (auto* id = mparse::ast_node_cast<const mparse::id_node>(&node)) {
+      if (!known.lookup(id->name())) {
+        return std::nullopt;
+      }
+      return impl::eval_id(known, id->name(), &node);
+    }
+  } catch (const eval_error&) {
+    fold_errors_.emplace(&node, std::current_exception());
+  }
+
+  return std::nullopt;
+}
+
+void compiled_expr::compiler::compile(const mparse::ast_node& root) {
+  push(root, false);
+
+  while (!stack_.empty()) {
+    frame& top = stack_.back();
+
+    if (top.next_child < top.child_count) {
+      const auto& child = mparse::get_child_slot(*top.node, top.next_child++);
+      push(*child, child.use_count() > 1);
+      continue;
+    }
+
+    frame cur = top;
+    stack_.pop_back();
+    leave(cur);
+  }
+}
+
+void compiled_expr::compiler::push(const mparse::ast_node& node, bool shared) {
+  shared = shared && mparse::child_count(node) > 0;
+  if (shared) {
+    if (auto it = shared_entries_.find(&node); it != shared_entries_.end()) {
+      pending_.push_back(it->second);
+      return;
+    }
+  }
+
+  bool folded = true;
+
+  if (auto it = folded_.find(&node); it != folded_.end()) {
+    expr_.constants_.push_back(it->second);
+    add_entry({.type = op_type::constant,
+               .index = expr_.constants_.size() - 1,
+               .node = &node},
+              0);
+  } else if (auto it = fold_errors_.find(&node); it != fold_errors_.end()) {
+    expr_.errors_.push_back(it->second);
+    add_entry({.type = op_type::raise,
+               .index = expr_.errors_.size() - 1,
+               .node = &node},
+              0);
+  } else {
+    folded = false;
+  }
+
+  if (folded) {
+    if (shared) {
+      shared_entries_.emplace(&node, pending_.back());
+    }
+    return;
+  }
+
+  frame fr{&node, shared, 0, mparse::child_count(node), {}};
+
+  if (auto lowered = lower(node)) {
+    fr.lowered = *lowered;
+    fr.child_count = lowered->operand_count;
+  } else if (mparse::ast_node_cast<const mparse::func_node>(&node)) {
+    // Look functions up before evaluating their arguments, like `eval`.
+    std::size_t slot = expr_.func_slots_++;
+    func_slots_.push_back(slot);
+    add_entry({.type = op_type::lookup_func, .index = slot, .node = &node}, 0);
+    pending_.pop_back(); // yields no operand
+  }
+
+  stack_.push_back(fr);
+}
+
+void compiled_expr::compiler::leave(const frame& fr) {
+  const mparse::ast_node& node = *fr.node;
+
+  if (fr.lowered.node) {
+    add_entry(fr.lowered, fr.lowered.operand_count);
+  } else if (mparse::ast_node_cast<const mparse::abs_node>(&node)) {
+    add_entry({.type = op_type::abs, .node = &node}, 1);
+  } else if (auto* unary =
+                 mparse::ast_node_cast<const mparse::unary_op_node>(&node)) {
+    // unary plus does nothing, and is not compiled
+    if (unary->type() == mparse::unary_op_type::neg) {
+      add_entry({.type = op_type::neg, .node = &node}, 1);
+    }
+  } else if (auto* bin =
+                 mparse::ast_node_cast<const mparse::binary_op_node>(&node)) {
+    add_entry(
+        {.type = op_type::binary_op, .binary_type = bin->type(), .node = &node},
+        2);
+  } else if (auto* func_node =
+                 mparse::ast_node_cast<const mparse::func_node>(&node)) {
+    std::size_t slot = func_slots_.back();
+    func_slots_.pop_back();
+
+    add_entry({.type = op_type::call_func, .index = slot, .node = &node},
+              func_node->args().size());
+  } else if (auto* lit =
+                 mparse::ast_node_cast<const mparse::literal_node>(&node)) {
+    add_entry({.type = op_type::literal, .val = lit->val(), .node = &node}, 0);
+  } else if (auto* id = mparse::ast_node_cast<const mparse::id_node>(&node)) {
+    add_entry(
+        {.type = op_type::var, .index = var_slot(id->name()), .node = &node},
+        0);
+  }
+
+  // parentheses are not compiled either
+  if (fr.shared) {
+    shared_entries_.emplace(&node, pending_.back());
+  }
+}
+
+auto compiled_expr::compiler::lower(const mparse::ast_node& node)
+    -> std::optional<entry> {
+  auto* bin = mparse::ast_node_cast<const mparse::binary_op_node>(&node);
+  if (!bin) {
+    return std::nullopt;
+  }
+
+  if (bin->type() == mparse::binary_op_type::add ||
+      bin->type() == mparse::binary_op_type::sub) {
+    // Polynomials falling back to `eval` must only depend on variables
+    // looked up at evaluation time.
+    auto coeffs = poly_matcher_.match(node);
+    if (!coeffs || (known_ && known_->lookup(poly_matcher_.var()))) {
+      return std::nullopt;
+    }
+
+    double coeff_sum = 0;
+    for (double coeff : *coeffs) {
+      coeff_sum += std::abs(coeff);
+    }
+
+    // Every intermediate result, either way, is bounded by
+    // `coeff_sum * (sqrt(2) * max_magnitude)^degree`.
+    auto degree = static_cast<double>(coeffs->size() - 1);
+    double max_magnitude =
+        std::pow(DBL_MAX / 4 / std::max(coeff_sum, 1.0), 1 / degree) / 2;
+
+    // The magnitude of `var` is at least that of either component, so the
+    // highest power (and thus every lower one) stays normal above this.
+    double min_magnitude = std::pow(DBL_MIN, 1 / degree) * 2;
+
+    std::reverse(coeffs->begin(), coeffs->end());
+    expr_.polys_.push_back({var_slot(poly_matcher_.var()), std::move(*coeffs),
+                            min_magnitude, max_magnitude});
+
+    return entry{.type = op_type::horner,
+                 .index = expr_.polys_.size() - 1,
+                 .node = &node};
+  }
+
+  return lower_binary(*bin);
+}
+
+auto compiled_expr::compiler::lower_binary(const mparse::binary_op_node& node)
+    -> std::optional<entry> {
+  auto rhs_val = real_constant(node.rhs());
+  if (!rhs_val) {
+    return std::nullopt;
+  }
+
+  // The constant itself is never compiled, so only the left-hand side remains
+  // as an operand.
+  entry ent{.operand_count = 1, .node = &node};
+
+  if (node.type() == mparse::binary_op_type::pow) {
+    if (auto exp = int_value(*rhs_val, max_powi_exponent); exp && *exp != 0) {
+      ent.type = op_type::powi;
+      ent.exponent = *exp;
+      return ent;
+    }
+
+    if (*rhs_val == 0.5) {
+      ent.type = op_type::sqrt;
+      return ent;
+    }
+  }
+
+  if (node.type() == mparse::binary_op_type::div && *rhs_val != 0) {
+    if (has_exact_reciprocal(*rhs_val)) {
+      ent.type = op_type::scale;
+      ent.val = 1 / *rhs_val;
+    } else {
+      ent.type = op_type::div_real;
+      ent.val = *rhs_val;
+    }
+    return ent;
+  }
+
+  return std::nullopt;
+}
+
+std::optional<double> compiled_expr::compiler::real_constant(
+    const mparse::ast_node* node) const {
+  if (auto it = folded_.find(node); it != folded_.end()) {
+    if (it->second.imag() == 0) {
+      return it->second.real();
+    }
+    return std::nullopt;
+  }
+  return constant_value(node);
+}
+
+std::size_t compiled_expr::compiler::var_slot(std::string_view name) {
+  auto [it, inserted] = var_slots_.try_emplace(name, expr_.vars_.size());
+  if (inserted) {
+    expr_.vars_.push_back(name);
+  }
+  return it->second;
+}
+
+void compiled_expr::compiler::add_entry(entry ent, std::size_t operand_count) {
+  ent.first_operand = static_cast<std::uint32_t>(expr_.operands_.size());
+  ent.operand_count = static_cast<std::uint32_t>(operand_count);
+
+  auto first = pending_.end() - operand_count;
+  expr_.operands_.insert(expr_.operands_.end(), first, pending_.end());
+  pending_.erase(first, pending_.end());
+
+  pending_.push_back(static_cast<std::uint32_t>(expr_.entries_.size()));
+  expr_.entries_.push_back(ent);
+}
+
+
+compiled_expr::compiled_expr(mparse::ast_node_ptr node)
+    : compiled_expr(std::move(node), nullptr) {}
+
+compiled_expr::compiled_expr(mparse::ast_node_ptr node, const var_scope* known)
+    : node_(std::move(node)) {
+  compiler comp(*this);
+  if (known) {
+    comp.fold_constants(*node_, *known);
+  }
+  comp.compile(*node_);
+}
+
+auto compiled_expr::bind(const var_scope& vscope) const -> bound_vars {
+  std::vector<const var_scope::binding*> bindings(vars_.size());
+  for (std::size_t i = 0; i < vars_.size(); i++) {
+    bindings[i] = vscope.find(vars_[i]);
+  }
+  return {vscope, std::move(bindings)};
+}
+
+number compiled_expr::eval(const bound_vars& vars,
+                           const func_scope& fscope) const {
+  assert(vars.bindings_.size() == vars_.size());
+
+  std::vector<number> values(entries_.size());
+  std::vector<const function*> funcs(func_slots_);
+  std::vector<number> args;
+
+  for (std::size_t i = 0; i < entries_.size(); i++) {
+    const entry& ent = entries_[i];
+    const std::uint32_t* operands = operands_.data() + ent.first_operand;
+    number& ret = values[i];
+
+    switch (ent.type) {
+    case op_type::abs:
+      ret = impl::eval_abs(values[operands[0]], ent.node);
+      break;
+    case op_type::neg:
+      ret = impl::eval_unary_op(mparse::unary_op_type::neg,
+                                values[operands[0]], ent.node);
+      break;
+    case op_type::binary_op:
+      ret = impl::eval_binary_op(ent.binary_type, values[operands[0]],
+                                 values[operands[1]], ent.node);
+      break;
+    case op_type::lookup_func: {
+      auto* func_node = static_cast<const mparse::func_node*>(ent.node);
+      funcs[ent.index] =
+          &impl::lookup_func(fscope, func_node->name(), ent.node);
+      break;
+    }
+    case op_type::call_func: {
+      auto* func_node = static_cast<const mparse::func_node*>(ent.node);
+      const function& func = *funcs[ent.index];
+
+      args.resize(ent.operand_count);
+      for (std::size_t j = 0; j < ent.operand_count; j++) {
+        args[j] = values[operands[j]];
+      }
+
+      ret = impl::call_func([&] { return func(args); }, func_node->name(),
+                            ent.node);
+      break;
+    }
+    case op_type::literal:
+      ret = impl::eval_literal(ent.val, ent.node);
+      break;
+    case op_type::var:
+      ret = impl::eval_binding(vars.bindings_[ent.index], vars_[ent.index],
+                               ent.node);
+      break;
+    case op_type::powi: {
+      number base = values[operands[0]];
+      ret = powi(base, ent.exponent);
+      if (!impl::is_finite(ret) || may_have_underflowed(ret)) {
+        ret = impl::eval_binary_op(mparse::binary_op_type::pow, base,
+                                   ent.exponent, ent.node);
+      }
+      break;
+    }
+    case op_type::sqrt:
+      ret = std::sqrt(values[operands[0]]);
+      break;
+    case op_type::scale:
+      ret = values[operands[0]] * ent.val;
+      if (!impl::is_finite(ret)) {
+        ret = impl::eval_binary_op(mparse::binary_op_type::div,
+                                   values[operands[0]], 1 / ent.val, ent.node);
+      }
+      break;
+    case op_type::div_real:
+      ret = values[operands[0]] / ent.val;
+      if (!impl::is_finite(ret)) {
+        ret = impl::eval_binary_op(mparse::binary_op_type::div,
+                                   values[operands[0]], ent.val, ent.node);
+      }
+      break;
+    case op_type::horner:
+      ret = eval_horner(ent, vars, fscope);
+      break;
+    case op_type::constant:
+      ret = constants_[ent.index];
+      break;
+    case op_type::raise:
+      std::rethrow_exception(errors_[ent.index]);
+    }
+  }
+
+  return values.back();
+}
+
+number compiled_expr::eval_horner(const entry& ent, const bound_vars& vars,
+                                  const func_scope& fscope) const {
+  const polynomial& poly = polys_[ent.index];
+
+  const var_scope::binding* binding = vars.bindings_[poly.var];
+  number x = binding ? binding->get() : 0.0;
+  double magnitude = std::max(std::abs(x.real()), std::abs(x.imag()));
+  if (!binding || !(magnitude <= poly.max_magnitude) ||
+      (magnitude != 0 && magnitude < poly.min_magnitude)) {
+    // Either unbound, not finite, or large or small enough for a power to
+    // overflow or underflow - evaluate the sum as written to report any error
+    // precisely.
+    return ast_ops::eval(*ent.node, vars.scope(), fscope);
+  }
+
+  number ret = poly.coeffs[0];
+  for (std::size_t i = 1; i < poly.coeffs.size(); i++) {
+    ret = ret * x + poly.coeffs[i];
+  }
+  return ret;
+}
+
+} // namespace ast_ops
\ No newline at end of file
@@ -0,0 +1,138 @@
+#pragma once
+
+#include "ast_ops/eval/scope.h"
+#include "ast_ops/eval/types.h"
+#include "mparse/ast.h"
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace ast_ops {
+
+// Expression lowered ahead of evaluation into a flat list of operations, for
+// evaluating it many times. Lowering applies strength reductions to constant
+// operands:
+//  - small integer powers become multiplication chains (square-and-multiply),
+//    and `x^0.5` becomes a square root
+//  - division by a constant becomes multiplication by its reciprocal where
+//    that is exact, and a cheaper real division otherwise
+//  - polynomials in a single variable with constant coefficients are
+//    evaluated in Horner form
+//
+// Results may differ from `eval` in the last bits, but errors are the same:
+// whenever a lowered operation fails, or a power computed by it may have
+// underflowed (which `eval` reports as out of range), the original operation
+// is re-run to raise the error `eval` would. Subtrees shared within the tree
+// are evaluated once, like `eval` does. Compiled expressions are immutable, and
+// can be evaluated from several threads at once.
+class compiled_expr {
+public:
+  // Variables of a compiled expression resolved against a scope once, so that
+  // evaluations read their bindings directly instead of looking every name
+  // up. Remains valid until the scope is modified; bindings made with
+  // `var_scope::set_binding_ref` still yield the current value of the host
+  // variable each time.
+  class bound_vars {
+  public:
+    const var_scope& scope() const { return *scope_; }
+
+  private:
+    friend class compiled_expr;
+
+    bound_vars(const var_scope& vscope,
+               std::vector<const var_scope::binding*> bindings)
+        : scope_(&vscope), bindings_(std::move(bindings)) {}
+
+    const var_scope* scope_;
+    std::vector<const var_scope::binding*> bindings_; // by variable slot
+  };
+
+  explicit compiled_expr(mparse::ast_node_ptr node);
+
+  const mparse::ast_node_ptr& node() const { return node_; }
+
+  // Variables looked up when evaluating, in order of first appearance.
+  const std::vector<std::string_view>& vars() const { return vars_; }
+
+  bound_vars bind(const var_scope& vscope) const;
+
+  // `vars` must have been bound by this expression.
+  number eval(const bound_vars& vars, const func_scope& fscope) const;
+
+  number eval(const var_scope& vscope, const func_scope& fscope) const {
+    return eval(bind(vscope), fscope);
+  }
+
+private:
+  friend compiled_expr specialize(mparse::ast_node_ptr node,
+                                  const var_scope& known);
+
+  // Compiles `node`, folding subtrees that can be computed from `known` if it
+  // is not null.
+  compiled_expr(mparse::ast_node_ptr node, const var_scope* known);
+
+  enum class op_type : std::uint8_t {
+    abs,
+    neg,
+    binary_op,
+    lookup_func,
+    call_func,
+    literal,
+    var,
+    powi,
+    sqrt,
+    scale,
+    div_real,
+    horner,
+    constant,
+    raise,
+  };
+
+  struct entry {
+    op_type type = {};
+    mparse::binary_op_type binary_type = {}; // binary operators only
+
+    // operands are `operands_[first_operand, first_operand + operand_count)`
+    std::uint32_t first_operand = 0;
+    std::uint32_t operand_count = 0;
+
+    // function or variable slot, or index into `polys_`, `constants_` or
+    // `errors_`
+    std::size_t index = 0;
+    int exponent = 0;      // `powi` only
+    double val = 0;        // literals, and the constant of `scale`/`div_real`
+
+    const mparse::ast_node* node = nullptr;
+  };
+
+  struct polynomial {
+    std::size_t var;            // variable slot
+    std::vector<double> coeffs; // highest degree first
+
+    // Range of magnitudes of the larger component of `var` for which no
+    // intermediate result can overflow, either in Horner form or as written,
+    // and no power of `var` underflows (besides zero).
+    double min_magnitude;
+    double max_magnitude;
+  };
+
+  class compiler;
+
+  number eval_horner(const entry& ent, const bound_vars& vars,
+                     const func_scope& fscope) const;
+
+  mparse::ast_node_ptr node_;
+
+  std::vector<entry> entries_;
+  std::vector<std::uint32_t> operands_;
+  std::vector<polynomial> polys_;
+  std::vector<number> constants_;
+  std::vector<std::exception_ptr> errors_;
+  std::vector<std::string_view> vars_; // by variable slot
+  std::size_t func_slots_ = 0;
+};
+
+} // namespace ast_ops
\ No newline at end of file
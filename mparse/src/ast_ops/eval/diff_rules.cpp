@@ -0,0 +1,310 @@
+#include "diff_rules.h"
+
+#include "ast_ops/eval/builtins.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <tuple>
+
+using namespace std::literals;
+
+namespace ast_ops {
+namespace {
+
+constexpr auto not_finite = std::numeric_limits<double>::quiet_NaN();
+
+
+// Derivatives of the builtins taking a single argument, given the argument and
+// the result.
+
+number d_sin(number z, number) {
+  return std::cos(z);
+}
+
+number d_cos(number z, number) {
+  return -std::sin(z);
+}
+
+number d_tan(number, number res) {
+  return 1.0 + res * res;
+}
+
+
+number d_asin(number z, number) {
+  return 1.0 / std::sqrt(1.0 - z * z);
+}
+
+number d_acos(number z, number) {
+  return -1.0 / std::sqrt(1.0 - z * z);
+}
+
+number d_atan(number z, number) {
+  return 1.0 / (1.0 + z * z);
+}
+
+
+number d_sinh(number z, number) {
+  return std::cosh(z);
+}
+
+number d_cosh(number z, number) {
+  return std::sinh(z);
+}
+
+number d_tanh(number, number res) {
+  return 1.0 - res * res;
+}
+
+
+number d_asinh(number z, number) {
+  return 1.0 / std::sqrt(z * z + 1.0);
+}
+
+number d_acosh(number z, number) {
+  return 1.0 / (std::sqrt(z - 1.0) * std::sqrt(z + 1.0));
+}
+
+number d_atanh(number z, number) {
+  return 1.0 / (1.0 - z * z);
+}
+
+
+number d_exp(number, number res) {
+  return res;
+}
+
+number d_ln(number z, number) {
+  return 1.0 / z;
+}
+
+
+number d_sqrt(number, number res) {
+  return 1.0 / (2.0 * res);
+}
+
+number d_cbrt(number, number res) {
+  return 1.0 / (3.0 * res * res);
+}
+
+
+// floor, ceil and round are piecewise constant
+number d_step(number, number) {
+  return 0;
+}
+
+
+template <number (*Deriv)(number, number)>
+void unary_rule(func_args args, number result, util::span<partial> partials) {
+  partials[0] = {Deriv(args[0], result)};
+}
+
+
+void log_rule(func_args args, number result, util::span<partial> partials) {
+  number base = args[0];
+  number ln_base = std::log(base);
+
+  partials[0] = {-result / (base * ln_base)};
+  partials[1] = {1.0 / (args[1] * ln_base)};
+}
+
+void nroot_rule(func_args args, number result, util::span<partial> partials) {
+  double n = args[0].real();
+  double val = std::abs(args[1].real());
+
+  // The result is constant in `n` where it is zero.
+  partials[0] = {result == 0.0 ? 0.0 : -result * std::log(val) / (n * n)};
+  partials[1] = {std::pow(val, 1 / n - 1) / n};
+}
+
+
+void re_rule(func_args, number, util::span<partial> partials) {
+  partials[0] = {0.5, 0.5};
+}
+
+void im_rule(func_args, number, util::span<partial> partials) {
+  partials[0] = {-0.5i, 0.5i};
+}
+
+void arg_rule(func_args args, number, util::span<partial> partials) {
+  number z = args[0];
+  if (z == 0.0) {
+    partials[0] = {not_finite};
+    return;
+  }
+
+  partials[0] = {-0.5i / z, 0.5i / std::conj(z)};
+}
+
+void conj_rule(func_args, number, util::span<partial> partials) {
+  partials[0] = {0, 1};
+}
+
+
+void mod_rule(func_args args, number, util::span<partial> partials) {
+  double a = args[0].real();
+  double b = args[1].real();
+
+  partials[0] = {1};
+  partials[1] = {-std::trunc(a / b)};
+}
+
+
+// min and max follow the argument they select, which is the first extremum.
+template <bool Max>
+void extremum_rule(func_args args, number, util::span<partial> partials) {
+  auto less = [](const number& a, const number& b) {
+    return a.real() < b.real();
+  };
+
+  auto it = Max ? std::max_element(args.begin(), args.end(), less)
+                : std::min_element(args.begin(), args.end(), less);
+
+  std::fill(partials.begin(), partials.end(), partial{0});
+  partials[it - args.begin()] = {1};
+}
+
+void avg_rule(func_args args, number, util::span<partial> partials) {
+  std::fill(partials.begin(), partials.end(),
+            partial{1.0 / static_cast<double>(args.size())});
+}
+
+
+struct func_diff_entry {
+  std::string_view name;
+  func_diff_rule rule;
+};
+
+// clang-format off
+
+constexpr std::array func_diff_rules = {
+    func_diff_entry{"sin", unary_rule<d_sin>},
+    func_diff_entry{"cos", unary_rule<d_cos>},
+    func_diff_entry{"tan", unary_rule<d_tan>},
+
+    func_diff_entry{"arcsin", unary_rule<d_asin>},
+    func_diff_entry{"asin", unary_rule<d_asin>},
+    func_diff_entry{"arccos", unary_rule<d_acos>},
+    func_diff_entry{"acos", unary_rule<d_acos>},
+    func_diff_entry{"arctan", unary_rule<d_atan>},
+    func_diff_entry{"atan", unary_rule<d_atan>},
+
+    func_diff_entry{"sinh", unary_rule<d_sinh>},
+    func_diff_entry{"cosh", unary_rule<d_cosh>},
+    func_diff_entry{"tanh", unary_rule<d_tanh>},
+
+    func_diff_entry{"arcsinh", unary_rule<d_asinh>},
+    func_diff_entry{"asinh", unary_rule<d_asinh>},
+    func_diff_entry{"arccosh", unary_rule<d_acosh>},
+    func_diff_entry{"acosh", unary_rule<d_acosh>},
+    func_diff_entry{"arctanh", unary_rule<d_atanh>},
+    func_diff_entry{"atanh", unary_rule<d_atanh>},
+
+    func_diff_entry{"exp", unary_rule<d_exp>},
+    func_diff_entry{"ln", unary_rule<d_ln>},
+    func_diff_entry{"log", log_rule},
+
+    func_diff_entry{"sqrt", unary_rule<d_sqrt>},
+    func_diff_entry{"cbrt", unary_rule<d_cbrt>},
+    func_diff_entry{"nroot", nroot_rule},
+
+    func_diff_entry{"re", re_rule},
+    func_diff_entry{"real", re_rule},
+    func_diff_entry{"im", im_rule},
+    func_diff_entry{"imag", im_rule},
+    func_diff_entry{"arg", arg_rule},
+    func_diff_entry{"conj", conj_rule},
+
+    func_diff_entry{"floor", unary_rule<d_step>},
+    func_diff_entry{"ceil", unary_rule<d_step>},
+    func_diff_entry{"round", unary_rule<d_step>},
+
+    func_diff_entry{"mod", mod_rule},
+
+    func_diff_entry{"min", extremum_rule<false>},
+    func_diff_entry{"max", extremum_rule<true>},
+    func_diff_entry{"avg", avg_rule},
+};
+
+// clang-format on
+
+constexpr bool has_func_diff_rule(std::string_view name) {
+  return std::any_of(
+      func_diff_rules.begin(), func_diff_rules.end(),
+      [&](const func_diff_entry& entry) { return entry.name == name; });
+}
+
+static_assert(std::apply(
+                  [](const auto&... funcs) {
+                    return (has_func_diff_rule(funcs.name) && ...);
+                  },
+                  builtin_funcs),
+              "Every builtin function needs a derivative rule");
+
+} // namespace
+
+
+partial abs_partial(number val) {
+  // |z| is only differentiable away from zero, as a function of real changes
+  double abs_val = std::abs(val);
+  if (abs_val == 0) {
+    return {not_finite};
+  }
+
+  return {std::conj(val) / (2 * abs_val), val / (2 * abs_val)};
+}
+
+partial unary_op_partial(mparse::unary_op_type type) {
+  return {type == mparse::unary_op_type::neg ? -1.0 : 1.0};
+}
+
+std::pair<partial, partial> binary_op_partials(mparse::binary_op_type type,
+                                               number lhs_val, number rhs_val,
+                                               number result) {
+  switch (type) {
+  case mparse::binary_op_type::add:
+    return {{1}, {1}};
+  case mparse::binary_op_type::sub:
+    return {{1}, {-1}};
+  case mparse::binary_op_type::mult:
+    return {{rhs_val}, {lhs_val}};
+  case mparse::binary_op_type::div:
+    return {{1.0 / rhs_val}, {-result / rhs_val}};
+  case mparse::binary_op_type::pow: {
+    number d_base;
+    if (rhs_val == 0.0) {
+      d_base = 0;
+    } else if (rhs_val == 1.0) {
+      d_base = 1;
+    } else if (lhs_val == 0.0) {
+      // the exponent is positive, or evaluation would have failed
+      d_base = rhs_val.real() > 1 ? 0 : not_finite;
+    } else {
+      d_base = rhs_val * std::pow(lhs_val, rhs_val - 1.0);
+    }
+
+    number d_exp = result == 0.0 ? 0.0 : std::log(lhs_val) * result;
+    return {{d_base}, {d_exp}};
+  }
+  default:
+    return {};
+  }
+}
+
+func_diff_rule find_func_diff_rule(std::string_view name) {
+  auto it = std::find_if(
+      func_diff_rules.begin(), func_diff_rules.end(),
+      [&](const func_diff_entry& entry) { return entry.name == name; });
+
+  return it != func_diff_rules.end() ? it->rule : nullptr;
+}
+
+func_diff_rule find_func_diff_rule(std::string_view name,
+                                   const function* func) {
+  if (!func || func != builtin_func_scope().lookup(name)) {
+    return nullptr;
+  }
+  return find_func_diff_rule(name);
+}
+
+} // namespace ast_ops
\ No newline at end of file
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "ast_ops/eval/types.h"
+#include "mparse/ast.h"
+#include "util/span.h"
+#include <string_view>
+#include <utility>
+
+namespace ast_ops {
+
+// Partial derivative of an operation with respect to one operand `z`, as a
+// pair of Wirtinger derivatives: the change in the result is
+// `d * dz + d_conj * conj(dz)`. `d_conj` is zero for holomorphic operations,
+// and lets operations such as `re` and `conj` be differentiated along real
+// changes of their operands.
+struct partial {
+  number d;
+  number d_conj = 0;
+};
+
+// Applies `p` to the change `dz` of its operand. Zero changes contribute
+// nothing even where the partial itself is not finite.
+inline number apply_partial(const partial& p, number dz) {
+  if (dz == 0.0) {
+    return 0;
+  }
+
+  number ret = p.d * dz;
+  if (p.d_conj != 0.0) {
+    ret += p.d_conj * std::conj(dz);
+  }
+  return ret;
+}
+
+// Composes the partial `outer` of a result with respect to `y` with the partial
+// `inner` of `y` with respect to `z`, giving the partial of the result with
+// respect to `z`.
+inline partial chain_partials(const partial& outer, const partial& inner) {
+  partial ret{0, 0};
+
+  if (outer.d != 0.0) {
+    ret.d += outer.d * inner.d;
+    if (inner.d_conj != 0.0) {
+      ret.d_conj += outer.d * inner.d_conj;
+    }
+  }
+
+  if (outer.d_conj != 0.0) {
+    ret.d += outer.d_conj * std::conj(inner.d_conj);
+    ret.d_conj += outer.d_conj * std::conj(inner.d);
+  }
+
+  return ret;
+}
+
+
+// Derivative rules, given the operands and the already computed result. Where
+// a derivative does not exist, the partial is not finite.
+
+partial abs_partial(number val);
+partial unary_op_partial(mparse::unary_op_type type);
+std::pair<partial, partial> binary_op_partials(mparse::binary_op_type type,
+                                               number lhs_val, number rhs_val,
+                                               number result);
+
+// Stores the partials of a function with respect to each of its arguments.
+using func_diff_rule = void (*)(func_args args, number result,
+                                util::span<partial> partials);
+
+// Returns the derivative rule of the builtin function `name`, or null if there
+// is none.
+func_diff_rule find_func_diff_rule(std::string_view name);
+
+// Returns the derivative rule for `func`, called as `name`: that of the builtin
+// function `name` if `func` is that very builtin, and null if it has been
+// overridden by another function.
+func_diff_rule find_func_diff_rule(std::string_view name,
+                                   const function* func);
+
+} // namespace ast_ops
\ No newline at end of file
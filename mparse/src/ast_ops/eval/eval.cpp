@@ -1,10 +1,14 @@
 #include "eval.h"
 
 #include "ast_ops/eval/eval_error.h"
+#include "ast_ops/eval/eval_ops.h"
 #include "mparse/ast.h"
-#include <cmath>
+#include "mparse/traversal.h"
+#include <cerrno>
+#include <optional>
 #include <sstream>
-#include <system_error>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 using namespace std::literals;
@@ -12,38 +16,45 @@ using namespace std::literals;
 namespace ast_ops {
 namespace {
 
-bool is_finite(number x) {
-  return std::isfinite(x.real()) && std::isfinite(x.imag());
-}
+using impl::eval_abs;
+using impl::eval_binary_op;
+using impl::eval_id;
+using impl::eval_literal;
+using impl::eval_unary_op;
+using impl::lookup_func;
 
-template <typename F>
-number check_range(F func, const mparse::ast_node& node) {
-  errno = 0;
-  number res = func();
-  if (errno || !is_finite(res)) {
-    throw eval_error("Result too large", eval_errc::out_of_range, &node);
-  }
-  return res;
+
+number call_func(const function& func, std::string_view name, func_args args,
+                 const mparse::ast_node* node) {
+  return impl::call_func([&] { return func(args); }, name, node);
 }
 
-template <typename F>
-number check_errno(F func) {
-  errno = 0;
-  number res = func();
-  if (!errno && !is_finite(res)) {
-    errno = ERANGE;
-  }
-  if (errno) {
-    throw std::system_error(errno, std::generic_category());
+
+mparse::binary_op_type get_binary_op(serialized_op op) {
+  switch (op) {
+  case serialized_op::sub:
+    return mparse::binary_op_type::sub;
+  case serialized_op::mult:
+    return mparse::binary_op_type::mult;
+  case serialized_op::div:
+    return mparse::binary_op_type::div;
+  case serialized_op::pow:
+    return mparse::binary_op_type::pow;
+  case serialized_op::add:
+  default:
+    return mparse::binary_op_type::add;
   }
-  return res;
 }
 
 
-struct eval_visitor : mparse::const_ast_visitor<eval_visitor> {
-  eval_visitor(const var_scope& vscope, const func_scope& fscope);
+struct eval_visitor : mparse::const_ast_visitor<eval_visitor>,
+                      mparse::ast_traversal<eval_visitor> {
+  eval_visitor(const var_scope& vscope, const func_scope& fscope,
+               bool fast = false);
+
+  void enter(const mparse::ast_node& node);
+  void leave(const mparse::ast_node& node);
 
-  void operator()(const mparse::unary_node& node);
   void operator()(const mparse::abs_node& node);
   void operator()(const mparse::unary_op_node& node);
   void operator()(const mparse::binary_op_node& node);
@@ -51,101 +62,283 @@ struct eval_visitor : mparse::const_ast_visitor<eval_visitor> {
   void operator()(const mparse::literal_node& node);
   void operator()(const mparse::id_node& node);
 
+  number pop_result();
+
+  bool stopped() const { return false; }
+
+  // In fast mode, no results are checked as they are computed. Instead,
+  // `poison` accumulates `val - val` over all of them, which stays zero unless
+  // one was not finite, and `failed` is set on errors that have finite
+  // results. Range errors with finite results, such as powers that underflow,
+  // are left in `errno`, which the caller clears beforehand. Other errors are
+  // still raised directly.
+  bool ok() const { return !failed && impl::is_finite(poison); }
+  void poison_with(number val) { poison += val - val; }
+
   const var_scope& vscope;
   const func_scope& fscope;
-  number result = 0;
+
+  bool fast;
+  bool failed = false;
+  number poison = 0;
+
+  // operands of nodes currently being evaluated
+  std::vector<number> results;
+
+  // functions of the `func_node`s currently being evaluated
+  std::vector<const function*> funcs;
 };
 
-eval_visitor::eval_visitor(const var_scope& vscope, const func_scope& fscope)
-    : vscope(vscope), fscope(fscope) {}
+eval_visitor::eval_visitor(const var_scope& vscope, const func_scope& fscope,
+                           bool fast)
+    : vscope(vscope), fscope(fscope), fast(fast) {}
 
-void eval_visitor::operator()(const mparse::unary_node& node) {
-  mparse::apply_visitor(*this, *node.child());
+void eval_visitor::enter(const mparse::ast_node& node) {
+  // Look functions up before evaluating their arguments, so that missing
+  // functions are reported first.
+  if (auto* func_node = mparse::ast_node_cast<const mparse::func_node>(&node)) {
+    funcs.push_back(&lookup_func(fscope, func_node->name(), &node));
+  }
+}
+
+void eval_visitor::leave(const mparse::ast_node& node) {
+  mparse::apply_visitor(*this, node);
 }
 
 void eval_visitor::operator()(const mparse::abs_node& node) {
-  result = check_range([&] { return std::abs(result); }, node);
+  if (fast) {
+    results.back() = std::abs(results.back());
+    poison_with(results.back());
+    return;
+  }
+  results.back() = eval_abs(results.back(), &node);
 }
 
 void eval_visitor::operator()(const mparse::unary_op_node& node) {
-  if (node.type() == mparse::unary_op_type::neg) {
-    result = check_range([&] { return -result; }, node);
+  if (fast) {
+    // negation cannot overflow
+    if (node.type() == mparse::unary_op_type::neg) {
+      results.back() = -results.back();
+    }
+    return;
   }
+  results.back() = eval_unary_op(node.type(), results.back(), &node);
 }
 
 void eval_visitor::operator()(const mparse::binary_op_node& node) {
-  mparse::apply_visitor(*this, *node.lhs());
-  number lhs_val = result;
-
-  mparse::apply_visitor(*this, *node.rhs());
-  number rhs_val = result;
-
-  result = check_range(
-      [&] {
-        switch (node.type()) {
-        case mparse::binary_op_type::add:
-          return lhs_val + rhs_val;
-        case mparse::binary_op_type::sub:
-          return lhs_val - rhs_val;
-        case mparse::binary_op_type::mult:
-          return lhs_val * rhs_val;
-        case mparse::binary_op_type::div:
-          if (rhs_val == 0.0) {
-            throw eval_error("Division by zero", eval_errc::div_by_zero, &node);
-          }
-          return lhs_val / rhs_val;
-        case mparse::binary_op_type::pow:
-          if (lhs_val == 0.0) {
-            if (rhs_val.imag()) {
-              throw eval_error("Raising zero to complex power",
-                               eval_errc::bad_pow, &node);
-            }
-            if (rhs_val.real() < 0) {
-              throw eval_error("Raising zero to negative power",
-                               eval_errc::bad_pow, &node);
-            }
-          }
-
-          return std::pow(lhs_val, rhs_val);
-        default:
-          return 0i; // deduce as complex
-        }
-      },
-      node);
+  number rhs_val = pop_result();
+  number lhs_val = pop_result();
+
+  if (fast) {
+    auto result =
+        impl::eval_binary_op_unchecked(node.type(), lhs_val, rhs_val);
+    failed = failed || !result;
+    results.push_back(result.value_or(0));
+    poison_with(results.back());
+    return;
+  }
+  results.push_back(eval_binary_op(node.type(), lhs_val, rhs_val, &node));
 }
 
 void eval_visitor::operator()(const mparse::func_node& node) {
-  auto* func = fscope.lookup(node.name());
-  if (!func) {
-    throw eval_error("Function '" + node.name() + "' not found",
-                     eval_errc::bad_func_call, &node);
+  const function* func = funcs.back();
+  funcs.pop_back();
+
+  // the arguments are the topmost results, in order
+  std::size_t arg_count = node.args().size();
+  func_args args(results.data() + results.size() - arg_count, arg_count);
+
+  // calls reset `errno`
+  failed = failed || (fast && errno);
+
+  number result = call_func(*func, node.name(), args, &node);
+
+  results.resize(results.size() - arg_count);
+  results.push_back(result);
+}
+
+void eval_visitor::operator()(const mparse::literal_node& node) {
+  if (fast) {
+    results.push_back(node.val());
+    poison_with(results.back());
+    return;
   }
+  results.push_back(eval_literal(node.val(), &node));
+}
 
-  std::vector<number> args;
-  for (const auto& arg : node.args()) {
-    mparse::apply_visitor(*this, *arg);
-    args.push_back(result);
+void eval_visitor::operator()(const mparse::id_node& node) {
+  if (fast) {
+    auto val = vscope.lookup(node.name());
+    failed = failed || !val;
+    results.push_back(val.value_or(0));
+    poison_with(results.back());
+    return;
   }
+  results.push_back(eval_id(vscope, node.name(), &node));
+}
 
-  try {
-    result = check_errno([&] { return (*func)(args); });
-  } catch (...) {
-    eval_error err("In function '" + node.name() + "'",
-                   eval_errc::bad_func_call, &node);
-    std::throw_with_nested(std::move(err));
+number eval_visitor::pop_result() {
+  number result = results.back();
+  results.pop_back();
+  return result;
+}
+
+
+// Reports errors by storing them rather than throwing, stopping evaluation at
+// the first one. Functions are called through their `try_function`s.
+struct try_eval_visitor : mparse::const_ast_visitor<try_eval_visitor>,
+                          mparse::ast_traversal<try_eval_visitor> {
+  try_eval_visitor(const var_scope& vscope, const func_scope& fscope);
+
+  void enter(const mparse::ast_node& node);
+  void leave(const mparse::ast_node& node);
+
+  void operator()(const mparse::abs_node& node);
+  void operator()(const mparse::unary_op_node& node);
+  void operator()(const mparse::binary_op_node& node);
+  void operator()(const mparse::func_node& node);
+  void operator()(const mparse::literal_node& node);
+  void operator()(const mparse::id_node& node);
+
+  bool stopped() const { return failure.has_value(); }
+
+  void fail(const impl::op_error* err, const mparse::ast_node& node);
+
+  const var_scope& vscope;
+  const func_scope& fscope;
+
+  std::optional<eval_failure> failure;
+
+  // operands of nodes currently being evaluated
+  std::vector<number> results;
+
+  // functions of the `func_node`s currently being evaluated
+  std::vector<const try_function*> funcs;
+};
+
+try_eval_visitor::try_eval_visitor(const var_scope& vscope,
+                                   const func_scope& fscope)
+    : vscope(vscope), fscope(fscope) {}
+
+void try_eval_visitor::enter(const mparse::ast_node& node) {
+  if (auto* func_node = mparse::ast_node_cast<const mparse::func_node>(&node)) {
+    auto* func = fscope.try_lookup(func_node->name());
+    if (!func) {
+      failure.emplace(eval_errc::bad_func_call, &node, func_node->name());
+      return;
+    }
+    funcs.push_back(func);
   }
 }
 
-void eval_visitor::operator()(const mparse::literal_node& node) {
-  result = check_range([&] { return node.val(); }, node);
+void try_eval_visitor::leave(const mparse::ast_node& node) {
+  mparse::apply_visitor(*this, node);
 }
 
-void eval_visitor::operator()(const mparse::id_node& node) {
-  if (auto val = vscope.lookup(node.name())) {
-    result = check_range([&] { return *val; }, node);
-  } else {
-    throw eval_error("Unbound variable '" + node.name() + "'",
-                     eval_errc::unbound_var, &node);
+void try_eval_visitor::operator()(const mparse::abs_node& node) {
+  fail(impl::try_abs(results.back(), results.back()), node);
+}
+
+void try_eval_visitor::operator()(const mparse::unary_op_node& node) {
+  fail(impl::try_unary_op(node.type(), results.back(), results.back()), node);
+}
+
+void try_eval_visitor::operator()(const mparse::binary_op_node& node) {
+  number rhs_val = results.back();
+  results.pop_back();
+  fail(impl::try_binary_op(node.type(), results.back(), rhs_val,
+                           results.back()),
+       node);
+}
+
+void try_eval_visitor::operator()(const mparse::func_node& node) {
+  const try_function* func = funcs.back();
+  funcs.pop_back();
+
+  std::size_t arg_count = node.args().size();
+  func_args args(results.data() + results.size() - arg_count, arg_count);
+
+  auto result = impl::try_call_func(*func, args, node.name(), &node);
+  if (!result) {
+    failure.emplace(std::move(result).error());
+    return;
+  }
+
+  results.resize(results.size() - arg_count);
+  results.push_back(*result);
+}
+
+void try_eval_visitor::operator()(const mparse::literal_node& node) {
+  results.emplace_back();
+  fail(impl::try_literal(node.val(), results.back()), node);
+}
+
+void try_eval_visitor::operator()(const mparse::id_node& node) {
+  auto result = impl::try_eval_id(vscope, node.name(), &node);
+  if (!result) {
+    failure.emplace(std::move(result).error());
+    return;
+  }
+  results.push_back(*result);
+}
+
+void try_eval_visitor::fail(const impl::op_error* err,
+                            const mparse::ast_node& node) {
+  if (err) {
+    failure.emplace(impl::make_failure(*err, &node));
+  }
+}
+
+
+// results of shared subtrees evaluated so far
+using shared_results = std::unordered_map<const mparse::ast_node*, number>;
+
+// Evaluates the tree rooted at `root` with `vis`, pushing its result. Subtrees
+// held by several parents (see `eliminate_common_subexprs`) are evaluated only
+// once, their results being kept in `results`; leaves are cheap enough to
+// evaluate again. Stops early once `vis` reports it has stopped.
+template <typename Vis>
+void eval_dag(Vis& vis, const mparse::ast_node& root, bool root_shared,
+              shared_results& results) {
+  struct frame {
+    const mparse::ast_node* node;
+    bool shared;
+    std::size_t next_child;
+  };
+
+  std::vector<frame> stack;
+
+  auto push = [&](const mparse::ast_node& node, bool shared) {
+    shared = shared && mparse::child_count(node) > 0;
+    if (shared) {
+      if (auto it = results.find(&node); it != results.end()) {
+        vis.results.push_back(it->second);
+        return;
+      }
+    }
+
+    vis.enter(node);
+    stack.push_back({&node, shared, 0});
+  };
+
+  push(root, root_shared);
+
+  while (!stack.empty() && !vis.stopped()) {
+    frame& top = stack.back();
+
+    if (top.next_child < mparse::child_count(*top.node)) {
+      const auto& child = mparse::get_child_slot(*top.node, top.next_child++);
+      push(*child, child.use_count() > 1);
+      continue;
+    }
+
+    frame cur = top;
+    stack.pop_back();
+
+    vis.leave(*cur.node);
+    if (cur.shared && !vis.stopped()) {
+      results.emplace(cur.node, vis.results.back());
+    }
   }
 }
 
@@ -155,8 +348,124 @@ void eval_visitor::operator()(const mparse::id_node& node) {
 number eval(const mparse::ast_node& node, const var_scope& vscope,
             const func_scope& fscope) {
   eval_visitor vis(vscope, fscope);
-  mparse::apply_visitor(vis, node);
-  return vis.result;
+  shared_results results;
+
+  eval_dag(vis, node, false, results);
+  return vis.results.back();
+}
+
+number eval_fast(const mparse::ast_node& node, const var_scope& vscope,
+                 const func_scope& fscope) {
+  eval_visitor vis(vscope, fscope, true);
+  shared_results results;
+
+  errno = 0;
+  try {
+    eval_dag(vis, node, false, results);
+    if (vis.ok() && !errno) {
+      return vis.results.back();
+    }
+  } catch (const eval_error&) {
+    // an earlier node may have failed unnoticed
+  }
+
+  return eval(node, vscope, fscope);
+}
+
+eval_result try_eval(const mparse::ast_node& node, const var_scope& vscope,
+                     const func_scope& fscope) {
+  try_eval_visitor vis(vscope, fscope);
+  shared_results results;
+
+  eval_dag(vis, node, false, results);
+  if (vis.failure) {
+    return util::unexpected(std::move(*vis.failure));
+  }
+  return vis.results.back();
+}
+
+std::vector<number> eval_all(util::span<const mparse::ast_node_ptr> nodes,
+                             const var_scope& vscope,
+                             const func_scope& fscope) {
+  eval_visitor vis(vscope, fscope);
+  shared_results results;
+
+  std::vector<number> ret;
+  for (const mparse::ast_node_ptr& root : nodes) {
+    eval_dag(vis, *root, root.use_count() > 1, results);
+    ret.push_back(vis.pop_result());
+  }
+
+  return ret;
+}
+
+number eval(const serialized_ast& ast, const var_scope& vscope,
+            const func_scope& fscope) {
+  // operands of nodes currently being evaluated
+  std::vector<number> results;
+
+  // functions of the nodes currently being evaluated
+  std::vector<const function*> funcs;
+
+  auto pop_result = [&] {
+    number result = results.back();
+    results.pop_back();
+    return result;
+  };
+
+  auto enter = [&](const serialized_node& node) {
+    if (node.op == serialized_op::func) {
+      funcs.push_back(&lookup_func(fscope, node.name, nullptr));
+    }
+  };
+
+  auto leave = [&](const serialized_node& node) {
+    switch (node.op) {
+    case serialized_op::paren:
+      break;
+    case serialized_op::abs:
+      results.back() = eval_abs(results.back(), nullptr);
+      break;
+    case serialized_op::plus:
+      break;
+    case serialized_op::neg:
+      results.back() = eval_unary_op(mparse::unary_op_type::neg,
+                                     results.back(), nullptr);
+      break;
+    case serialized_op::add:
+    case serialized_op::sub:
+    case serialized_op::mult:
+    case serialized_op::div:
+    case serialized_op::pow: {
+      number rhs_val = pop_result();
+      number lhs_val = pop_result();
+      results.push_back(
+          eval_binary_op(get_binary_op(node.op), lhs_val, rhs_val, nullptr));
+      break;
+    }
+    case serialized_op::func: {
+      const function* func = funcs.back();
+      funcs.pop_back();
+
+      func_args args(results.data() + results.size() - node.child_count,
+                     node.child_count);
+      number result = call_func(*func, node.name, args, nullptr);
+
+      results.resize(results.size() - node.child_count);
+      results.push_back(result);
+      break;
+    }
+    case serialized_op::literal:
+      results.push_back(eval_literal(node.val, nullptr));
+      break;
+    case serialized_op::id:
+      results.push_back(eval_id(vscope, node.name, nullptr));
+      break;
+    }
+  };
+
+  fold_serialized(ast, enter, leave);
+  return results.back();
 }
 
 } // namespace ast_ops
\ No newline at end of file
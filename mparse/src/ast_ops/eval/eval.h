@@ -1,15 +1,48 @@
 #pragma once
 
+#include "ast_ops/eval/eval_error.h"
 #include "ast_ops/eval/scope.h"
 #include "ast_ops/eval/types.h"
+#include "ast_ops/serialize.h"
 #include "mparse/ast.h"
+#include "util/expected.h"
+#include "util/span.h"
 #include <stdexcept>
 #include <string_view>
 #include <vector>
 
 namespace ast_ops {
 
+// Subtrees shared within `node` (see `eliminate_common_subexprs`) are evaluated
+// once.
 number eval(const mparse::ast_node& node, const var_scope& vscope,
             const func_scope& fscope);
 
+// Like `eval`, but skips checking the result of every operation for overflow.
+// Only function calls and problems with finite results (such as division by
+// zero) are checked as they occur; everything else, including underflow, is
+// detected once the whole tree has been evaluated. On any error, the tree is
+// evaluated again with `eval` to raise the error it would. Faster when errors
+// are rare.
+number eval_fast(const mparse::ast_node& node, const var_scope& vscope,
+                 const func_scope& fscope);
+
+using eval_result = util::expected<number, eval_failure>;
+
+// Like `eval`, but reports errors as values instead of throwing them, for
+// callers expecting many of them. Functions are called through their
+// `try_function`s, so builtins fail without throwing at all. Stops at the first
+// error, which is the same one `eval` would raise.
+eval_result try_eval(const mparse::ast_node& node, const var_scope& vscope,
+                     const func_scope& fscope);
+
+// Evaluates several trees at once, such as a function and its derivative.
+// Subtrees shared between or within them are evaluated only once.
+std::vector<number> eval_all(util::span<const mparse::ast_node_ptr> nodes,
+                             const var_scope& vscope, const func_scope& fscope);
+
+// Evaluates a serialized tree in place. Errors carry no node.
+number eval(const serialized_ast& ast, const var_scope& vscope,
+            const func_scope& fscope);
+
 } // namespace ast_ops
\ No newline at end of file
@@ -1,6 +1,8 @@
 #include "eval_error.h"
 
 #include <algorithm>
+#include <sstream>
+#include <system_error>
 
 namespace ast_ops {
 
@@ -8,14 +10,130 @@ eval_error::eval_error(std::string_view what, eval_errc code,
                        const mparse::ast_node* node)
     : std::runtime_error(what.data()), code_(code), node_(node) {}
 
-arity_error::arity_error(std::string_view what, std::size_t expected, std::size_t provided)
+arity_error::arity_error(std::string_view what, std::size_t expected,
+                         std::size_t provided)
     : std::runtime_error(what.data()),
       expected_(expected),
       provided_(provided) {}
 
-func_arg_error::func_arg_error(std::string_view what, std::vector<std::size_t> indices)
+func_arg_error::func_arg_error(std::string_view what,
+                               std::vector<std::size_t> indices)
     : std::runtime_error(what.data()), indices_(std::move(indices)) {
   std::sort(indices_.begin(), indices_.end());
 }
 
+
+func_error func_error::arity(std::size_t expected, std::size_t provided,
+                             std::string_view what) {
+  func_error err(kind::arity);
+  err.what_ = what;
+  err.expected_ = expected;
+  err.provided_ = provided;
+  return err;
+}
+
+func_error func_error::arg(std::string_view what,
+                           std::vector<std::size_t> indices) {
+  func_error err(kind::arg);
+  err.what_ = what;
+  err.indices_ = std::move(indices);
+  std::sort(err.indices_.begin(), err.indices_.end());
+  return err;
+}
+
+func_error func_error::range(int err_no) {
+  func_error err(kind::range);
+  err.errno_ = err_no;
+  return err;
+}
+
+func_error func_error::exception(std::exception_ptr exc) {
+  func_error err(kind::other);
+  err.exc_ = std::move(exc);
+  return err;
+}
+
+std::string func_error::message() const {
+  switch (type_) {
+  case kind::arity:
+    if (what_.empty()) {
+      std::ostringstream msg;
+      msg << "wrong number of arguments (" << expected_ << " expected, "
+          << provided_ << " provided)";
+      return msg.str();
+    }
+    return std::string(what_);
+  case kind::arg:
+    return std::string(what_);
+  case kind::range:
+    return std::generic_category().message(errno_);
+  case kind::other:
+  default:
+    try {
+      std::rethrow_exception(exc_);
+    } catch (const std::exception& exc) {
+      return exc.what();
+    } catch (...) {
+      return "unknown error";
+    }
+  }
+}
+
+void func_error::raise() const {
+  switch (type_) {
+  case kind::arity:
+    throw arity_error(message(), expected_, provided_);
+  case kind::arg:
+    throw func_arg_error(what_, indices_);
+  case kind::range:
+    throw std::system_error(errno_, std::generic_category());
+  case kind::other:
+  default:
+    std::rethrow_exception(exc_);
+  }
+}
+
+
+eval_failure::eval_failure(eval_errc code, std::string_view what,
+                           const mparse::ast_node* node)
+    : code_(code), what_(what), node_(node) {}
+
+eval_failure::eval_failure(eval_errc code, const mparse::ast_node* node,
+                           std::string_view name)
+    : code_(code), name_(name), node_(node) {}
+
+eval_failure::eval_failure(const mparse::ast_node* node,
+                           std::string_view func_name, func_error cause)
+    : code_(eval_errc::bad_func_call),
+      name_(func_name),
+      node_(node),
+      cause_(std::move(cause)) {}
+
+std::string eval_failure::message() const {
+  switch (code_) {
+  case eval_errc::unbound_var:
+    return "Unbound variable '" + std::string(name_) + "'";
+  case eval_errc::bad_func_call:
+    if (cause_) {
+      return "In function '" + std::string(name_) + "'";
+    }
+    return "Function '" + std::string(name_) + "' not found";
+  default:
+    return std::string(what_);
+  }
+}
+
+void eval_failure::raise() const {
+  eval_error err(message(), code_, node_);
+  if (!cause_) {
+    throw err;
+  }
+
+  try {
+    cause_->raise();
+  } catch (...) {
+    std::throw_with_nested(std::move(err));
+  }
+}
+
 } // namespace ast_ops
\ No newline at end of file
@@ -2,7 +2,11 @@
 
 #include "mparse/ast.h"
 #include "util/span.h"
+#include <cstddef>
+#include <exception>
+#include <optional>
 #include <stdexcept>
+#include <string>
 #include <string_view>
 #include <vector>
 
@@ -15,6 +19,7 @@ enum class eval_errc {
   unbound_var,
   bad_func_call,
   out_of_range,
+  no_derivative,
 };
 
 class eval_error : public std::runtime_error {
@@ -54,4 +59,79 @@ private:
   std::vector<std::size_t> indices_;
 };
 
+
+// Failure of a function call reported as a value rather than thrown, for the
+// non-throwing function path (see `wrap_try_function`). `what` must be a
+// string with static storage; full messages are only built when asked for.
+class func_error {
+public:
+  enum class kind { arity, arg, range, other };
+
+  // A default message mentioning both counts is used if `what` is empty.
+  static func_error arity(std::size_t expected, std::size_t provided,
+                          std::string_view what = {});
+  static func_error arg(std::string_view what,
+                        std::vector<std::size_t> indices);
+  static func_error range(int err);
+  static func_error exception(std::exception_ptr exc);
+
+  kind type() const { return type_; }
+
+  std::size_t expected() const { return expected_; }
+  std::size_t provided() const { return provided_; }
+  util::span<const std::size_t> indices() const { return indices_; }
+
+  std::string message() const;
+
+  // Throws the exception reporting this failure on the throwing path:
+  // `arity_error`, `func_arg_error`, `std::system_error` or the original
+  // exception.
+  [[noreturn]] void raise() const;
+
+private:
+  explicit func_error(kind type) : type_(type) {}
+
+  kind type_;
+  std::string_view what_;
+  std::size_t expected_ = 0;
+  std::size_t provided_ = 0;
+  std::vector<std::size_t> indices_;
+  int errno_ = 0;
+  std::exception_ptr exc_;
+};
+
+
+// Evaluation error reported as a value by `try_eval`, carrying what the
+// corresponding `eval_error` would. `what` must be a string with static
+// storage, and `name` (the variable or function for `unbound_var` and
+// `bad_func_call`) must outlive the failure; the message is only built when
+// asked for.
+class eval_failure {
+public:
+  eval_failure(eval_errc code, std::string_view what,
+               const mparse::ast_node* node);
+  eval_failure(eval_errc code, const mparse::ast_node* node,
+               std::string_view name);
+  eval_failure(const mparse::ast_node* node, std::string_view func_name,
+               func_error cause);
+
+  eval_errc code() const { return code_; }
+  const mparse::ast_node* node() const { return node_; }
+
+  // Why the function call failed, for `bad_func_call`s of existing functions.
+  const func_error* cause() const { return cause_ ? &*cause_ : nullptr; }
+
+  std::string message() const;
+
+  // Throws the `eval_error` evaluation would, with the cause nested.
+  [[noreturn]] void raise() const;
+
+private:
+  eval_errc code_;
+  std::string_view what_;
+  std::string_view name_;
+  const mparse::ast_node* node_;
+  std::optional<func_error> cause_;
+};
+
 } // namespace ast_ops
\ No newline at end of file
@@ -0,0 +1,267 @@
+#pragma once
+
+#include "ast_ops/eval/eval_error.h"
+#include "ast_ops/eval/scope.h"
+#include "ast_ops/eval/types.h"
+#include "mparse/ast.h"
+#include "util/expected.h"
+#include <cerrno>
+#include <cmath>
+#include <exception>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+
+namespace ast_ops::impl {
+
+// Operation semantics, shared by all evaluators. `node` is attached to any
+// errors raised, and may be null when there is no tree to point to.
+//
+// Arithmetic operations also have non-throwing `try_` counterparts, which
+// store their result in `res` and return the error they ran into, if any.
+
+struct op_error {
+  eval_errc code;
+  std::string_view what;
+};
+
+inline constexpr op_error out_of_range_error = {eval_errc::out_of_range,
+                                                "Result too large"};
+inline constexpr op_error div_by_zero_error = {eval_errc::div_by_zero,
+                                               "Division by zero"};
+inline constexpr op_error complex_pow_error = {
+    eval_errc::bad_pow, "Raising zero to complex power"};
+inline constexpr op_error negative_pow_error = {
+    eval_errc::bad_pow, "Raising zero to negative power"};
+
+[[noreturn]] inline void raise(const op_error& err,
+                               const mparse::ast_node* node) {
+  throw eval_error(err.what, err.code, node);
+}
+
+inline eval_failure make_failure(const op_error& err,
+                                 const mparse::ast_node* node) {
+  return eval_failure(err.code, err.what, node);
+}
+
+
+inline bool is_finite(number x) {
+  return std::isfinite(x.real()) && std::isfinite(x.imag());
+}
+
+template <typename F>
+const op_error* try_check_range(F func, number& res) {
+  errno = 0;
+  res = func();
+  if (errno || !is_finite(res)) {
+    return &out_of_range_error;
+  }
+  return nullptr;
+}
+
+template <typename F>
+number check_range(F func, const mparse::ast_node* node) {
+  number res;
+  if (auto* err = try_check_range(func, res)) {
+    raise(*err, node);
+  }
+  return res;
+}
+
+template <typename F>
+number check_errno(F func) {
+  errno = 0;
+  number res = func();
+  if (!errno && !is_finite(res)) {
+    errno = ERANGE;
+  }
+  if (errno) {
+    throw std::system_error(errno, std::generic_category());
+  }
+  return res;
+}
+
+
+inline const op_error* try_abs(number val, number& res) {
+  return try_check_range([&] { return std::abs(val); }, res);
+}
+
+inline number eval_abs(number val, const mparse::ast_node* node) {
+  return check_range([&] { return std::abs(val); }, node);
+}
+
+inline const op_error* try_unary_op(mparse::unary_op_type type, number val,
+                                    number& res) {
+  if (type == mparse::unary_op_type::neg) {
+    return try_check_range([&] { return -val; }, res);
+  }
+  res = val;
+  return nullptr;
+}
+
+inline number eval_unary_op(mparse::unary_op_type type, number val,
+                            const mparse::ast_node* node) {
+  if (type == mparse::unary_op_type::neg) {
+    return check_range([&] { return -val; }, node);
+  }
+  return val;
+}
+
+inline const op_error* try_binary_op(mparse::binary_op_type type,
+                                     number lhs_val, number rhs_val,
+                                     number& res) {
+  using namespace std::literals;
+
+  if (type == mparse::binary_op_type::div && rhs_val == 0.0) {
+    return &div_by_zero_error;
+  }
+  if (type == mparse::binary_op_type::pow && lhs_val == 0.0) {
+    if (rhs_val.imag()) {
+      return &complex_pow_error;
+    }
+    if (rhs_val.real() < 0) {
+      return &negative_pow_error;
+    }
+  }
+
+  return try_check_range(
+      [&] {
+        switch (type) {
+        case mparse::binary_op_type::add:
+          return lhs_val + rhs_val;
+        case mparse::binary_op_type::sub:
+          return lhs_val - rhs_val;
+        case mparse::binary_op_type::mult:
+          return lhs_val * rhs_val;
+        case mparse::binary_op_type::div:
+          return lhs_val / rhs_val;
+        case mparse::binary_op_type::pow:
+          return std::pow(lhs_val, rhs_val);
+        default:
+          return 0i; // deduce as complex
+        }
+      },
+      res);
+}
+
+inline number eval_binary_op(mparse::binary_op_type type, number lhs_val,
+                             number rhs_val, const mparse::ast_node* node) {
+  number res;
+  if (auto* err = try_binary_op(type, lhs_val, rhs_val, res)) {
+    raise(*err, node);
+  }
+  return res;
+}
+
+// Unchecked counterpart of `eval_binary_op`, for evaluators that check results
+// later. Returns nothing where `eval_binary_op` would raise an error even
+// though the result may be finite (division by zero, bad powers of zero).
+inline std::optional<number> eval_binary_op_unchecked(
+    mparse::binary_op_type type, number lhs_val, number rhs_val) {
+  switch (type) {
+  case mparse::binary_op_type::add:
+    return lhs_val + rhs_val;
+  case mparse::binary_op_type::sub:
+    return lhs_val - rhs_val;
+  case mparse::binary_op_type::mult:
+    return lhs_val * rhs_val;
+  case mparse::binary_op_type::div:
+    if (rhs_val == 0.0) {
+      return std::nullopt;
+    }
+    return lhs_val / rhs_val;
+  case mparse::binary_op_type::pow:
+    if (lhs_val == 0.0 && (rhs_val.imag() || rhs_val.real() < 0)) {
+      return std::nullopt;
+    }
+    return std::pow(lhs_val, rhs_val);
+  default:
+    return std::nullopt;
+  }
+}
+
+inline const op_error* try_literal(double val, number& res) {
+  return try_check_range([&] { return val; }, res);
+}
+
+inline number eval_literal(double val, const mparse::ast_node* node) {
+  return check_range([&] { return val; }, node);
+}
+
+// Evaluates a variable already resolved to `binding`, which is null if `name`
+// is unbound.
+inline number eval_binding(const var_scope::binding* binding,
+                           std::string_view name,
+                           const mparse::ast_node* node) {
+  if (binding) {
+    return check_range([&] { return binding->get(); }, node);
+  }
+  eval_failure(eval_errc::unbound_var, node, name).raise();
+}
+
+inline number eval_id(const var_scope& vscope, std::string_view name,
+                      const mparse::ast_node* node) {
+  return eval_binding(vscope.find(name), name, node);
+}
+
+inline util::expected<number, eval_failure> try_eval_id(
+    const var_scope& vscope, std::string_view name,
+    const mparse::ast_node* node) {
+  auto val = vscope.lookup(name);
+  if (!val) {
+    return util::unexpected(eval_failure(eval_errc::unbound_var, node, name));
+  }
+
+  number res;
+  if (auto* err = try_check_range([&] { return *val; }, res)) {
+    return util::unexpected(make_failure(*err, node));
+  }
+  return res;
+}
+
+inline const function& lookup_func(const func_scope& fscope,
+                                   std::string_view name,
+                                   const mparse::ast_node* node) {
+  auto* func = fscope.lookup(name);
+  if (!func) {
+    eval_failure(eval_errc::bad_func_call, node, name).raise();
+  }
+  return *func;
+}
+
+// Runs `func`, which calls the function `name`, reporting any failure as an
+// evaluation error with the original cause nested.
+template <typename F>
+number call_func(F func, std::string_view name, const mparse::ast_node* node) {
+  try {
+    return check_errno(func);
+  } catch (...) {
+    eval_error err("In function '" + std::string(name) + "'",
+                   eval_errc::bad_func_call, node);
+    std::throw_with_nested(std::move(err));
+  }
+}
+
+// Non-throwing counterpart of `call_func`, calling `func` with `args`.
+inline util::expected<number, eval_failure> try_call_func(
+    const try_function& func, func_args args, std::string_view name,
+    const mparse::ast_node* node) {
+  errno = 0;
+  func_result res = func(args);
+  if (!res) {
+    return util::unexpected(eval_failure(node, name, std::move(res).error()));
+  }
+
+  int err = errno;
+  if (!err && !is_finite(*res)) {
+    err = ERANGE;
+  }
+  if (err) {
+    return util::unexpected(eval_failure(node, name, func_error::range(err)));
+  }
+  return *res;
+}
+
+} // namespace ast_ops::impl
\ No newline at end of file
@@ -0,0 +1,192 @@
+#include "forward_diff.h"
+
+#include "ast_ops/eval/diff_rules.h"
+#include "ast_ops/eval/eval_error.h"
+#include "ast_ops/eval/eval_ops.h"
+#include "mparse/traversal.h"
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace ast_ops {
+namespace {
+
+using impl::eval_abs;
+using impl::eval_binary_op;
+using impl::eval_id;
+using impl::eval_literal;
+using impl::eval_unary_op;
+using impl::lookup_func;
+
+
+struct forward_diff_visitor : mparse::const_ast_visitor<forward_diff_visitor>,
+                              mparse::ast_traversal<forward_diff_visitor> {
+  forward_diff_visitor(const var_scope& vscope, const func_scope& fscope,
+                       util::span<const std::string_view> wrt);
+
+  void enter(const mparse::ast_node& node);
+  void leave(const mparse::ast_node& node);
+
+  void operator()(const mparse::abs_node& node);
+  void operator()(const mparse::unary_op_node& node);
+  void operator()(const mparse::binary_op_node& node);
+  void operator()(const mparse::func_node& node);
+  void operator()(const mparse::literal_node& node);
+  void operator()(const mparse::id_node& node);
+
+  // Tangent lanes of the result `idx` places below the top of the stack.
+  util::span<number> tangents_of(std::size_t idx);
+
+  void push_result(number val);
+
+  // Replaces the topmost `count` results with `val`, whose tangents are
+  // combined from theirs with `partials`.
+  void reduce_results(std::size_t count, number val,
+                      util::span<const partial> partials,
+                      const mparse::ast_node& node);
+
+  const var_scope& vscope;
+  const func_scope& fscope;
+  util::span<const std::string_view> wrt;
+
+  // operands of nodes currently being evaluated, each with `wrt.size()`
+  // tangents stored contiguously in `tangents`
+  std::vector<number> results;
+  std::vector<number> tangents;
+
+  // functions of the `func_node`s currently being evaluated
+  std::vector<const function*> funcs;
+
+  // scratch space
+  std::vector<partial> func_partials;
+  std::vector<number> lanes;
+};
+
+forward_diff_visitor::forward_diff_visitor(
+    const var_scope& vscope, const func_scope& fscope,
+    util::span<const std::string_view> wrt)
+    : vscope(vscope), fscope(fscope), wrt(wrt) {}
+
+void forward_diff_visitor::enter(const mparse::ast_node& node) {
+  if (auto* func_node = mparse::ast_node_cast<const mparse::func_node>(&node)) {
+    funcs.push_back(&lookup_func(fscope, func_node->name(), &node));
+  }
+}
+
+void forward_diff_visitor::leave(const mparse::ast_node& node) {
+  mparse::apply_visitor(*this, node);
+}
+
+void forward_diff_visitor::operator()(const mparse::abs_node& node) {
+  number val = results.back();
+  partial p = abs_partial(val);
+  reduce_results(1, eval_abs(val, &node), {&p, 1}, node);
+}
+
+void forward_diff_visitor::operator()(const mparse::unary_op_node& node) {
+  partial p = unary_op_partial(node.type());
+  reduce_results(1, eval_unary_op(node.type(), results.back(), &node), {&p, 1},
+                 node);
+}
+
+void forward_diff_visitor::operator()(const mparse::binary_op_node& node) {
+  number lhs_val = results[results.size() - 2];
+  number rhs_val = results.back();
+  number result = eval_binary_op(node.type(), lhs_val, rhs_val, &node);
+
+  auto [lhs_partial, rhs_partial] =
+      binary_op_partials(node.type(), lhs_val, rhs_val, result);
+  partial ops[] = {lhs_partial, rhs_partial};
+  reduce_results(2, result, ops, node);
+}
+
+void forward_diff_visitor::operator()(const mparse::func_node& node) {
+  const function* func = funcs.back();
+  funcs.pop_back();
+
+  // the arguments are the topmost results, in order
+  std::size_t arg_count = node.args().size();
+  func_args args(results.data() + results.size() - arg_count, arg_count);
+
+  number result =
+      impl::call_func([&] { return (*func)(args); }, node.name(), &node);
+
+  func_partials.assign(arg_count, partial{0});
+  if (auto rule = find_func_diff_rule(node.name(), func)) {
+    rule(args, result, func_partials);
+  } else {
+    // only an error if some argument actually varies
+    auto first = tangents.end() - arg_count * wrt.size();
+    if (std::any_of(first, tangents.end(),
+                    [](const number& x) { return x != 0.0; })) {
+      throw eval_error("Function '" + node.name() + "' has no derivative",
+                       eval_errc::no_derivative, &node);
+    }
+  }
+
+  reduce_results(arg_count, result, func_partials, node);
+}
+
+void forward_diff_visitor::operator()(const mparse::literal_node& node) {
+  push_result(eval_literal(node.val(), &node));
+}
+
+void forward_diff_visitor::operator()(const mparse::id_node& node) {
+  push_result(eval_id(vscope, node.name(), &node));
+
+  auto var_tangents = tangents_of(0);
+  for (std::ptrdiff_t i = 0; i < wrt.size(); i++) {
+    if (wrt[i] == node.name()) {
+      var_tangents[i] = 1;
+    }
+  }
+}
+
+util::span<number> forward_diff_visitor::tangents_of(std::size_t idx) {
+  std::size_t lane_count = wrt.size();
+  return {tangents.data() + tangents.size() - (idx + 1) * lane_count,
+          static_cast<std::ptrdiff_t>(lane_count)};
+}
+
+void forward_diff_visitor::push_result(number val) {
+  results.push_back(val);
+  tangents.resize(tangents.size() + wrt.size());
+}
+
+void forward_diff_visitor::reduce_results(std::size_t count, number val,
+                                          util::span<const partial> partials,
+                                          const mparse::ast_node& node) {
+  std::size_t lane_count = wrt.size();
+  lanes.assign(lane_count, 0);
+
+  for (std::size_t i = 0; i < count; i++) {
+    auto operand_lanes = tangents_of(count - 1 - i);
+    for (std::size_t lane = 0; lane < lane_count; lane++) {
+      lanes[lane] += apply_partial(partials[i], operand_lanes[lane]);
+    }
+  }
+
+  if (!std::all_of(lanes.begin(), lanes.end(), impl::is_finite)) {
+    throw eval_error("Derivative not finite", eval_errc::no_derivative, &node);
+  }
+
+  results.resize(results.size() - count);
+  tangents.resize(tangents.size() - count * lane_count);
+
+  results.push_back(val);
+  tangents.insert(tangents.end(), lanes.begin(), lanes.end());
+}
+
+} // namespace
+
+
+diff_result eval_forward_diff(const mparse::ast_node& node,
+                              const var_scope& vscope, const func_scope& fscope,
+                              util::span<const std::string_view> wrt) {
+  forward_diff_visitor vis(vscope, fscope, wrt);
+  mparse::traverse(vis, node);
+  return {vis.results.back(), std::move(vis.tangents)};
+}
+
+} // namespace ast_ops
\ No newline at end of file
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "ast_ops/eval/scope.h"
+#include "ast_ops/eval/types.h"
+#include "mparse/ast.h"
+#include "util/span.h"
+#include <string_view>
+#include <vector>
+
+namespace ast_ops {
+
+// Value of an expression along with its partial derivatives, in the order the
+// variables were requested.
+struct diff_result {
+  number value;
+  std::vector<number> derivs;
+};
+
+// Evaluates `node` like `eval`, computing its partial derivatives with respect
+// to the variables `wrt` in the same traversal (forward-mode automatic
+// differentiation, with one tangent lane per variable).
+//
+// Derivatives are taken along real changes of each variable, which agrees with
+// the complex derivative wherever the expression is holomorphic. Builtin
+// functions are differentiated with their rules; functions `fscope` binds
+// instead of a builtin have none. Evaluating at a point where a needed
+// derivative does not exist, or through a function without a rule, raises an
+// `eval_error` with code `no_derivative`.
+diff_result eval_forward_diff(const mparse::ast_node& node,
+                              const var_scope& vscope, const func_scope& fscope,
+                              util::span<const std::string_view> wrt);
+
+} // namespace ast_ops
\ No newline at end of file
@@ -1,37 +1,55 @@
 #include "func_util.h"
 
 #include "ast_ops/eval/eval_error.h"
-#include <sstream>
 
 namespace ast_ops::impl {
 
-void check_arity(std::size_t expected, std::size_t provided) {
+std::optional<func_error> arity_failure(std::size_t expected,
+                                        std::size_t provided) {
   if (expected != provided) {
-    std::ostringstream msg;
-    msg << "wrong number of arguments (" << expected << " expected, "
-        << provided << " provided)";
-    throw arity_error(msg.str(), expected, provided);
+    return func_error::arity(expected, provided);
+  }
+  return std::nullopt;
+}
+
+void check_arity(std::size_t expected, std::size_t provided) {
+  if (auto err = arity_failure(expected, provided)) {
+    err->raise();
   }
 }
 
 
-void throw_if_nonreal(std::vector<std::size_t> nonreal_args) {
-  if (!nonreal_args.empty()) {
-    std::ostringstream msg;
-    msg << (nonreal_args.size() > 1 ? "arguments" : "argument")
-        << " must be real";
-    throw func_arg_error(msg.str(), std::move(nonreal_args));
+std::optional<func_error> nonreal_failure(
+    std::vector<std::size_t> nonreal_args) {
+  if (nonreal_args.empty()) {
+    return std::nullopt;
   }
+
+  return func_error::arg(nonreal_args.size() > 1 ? "arguments must be real"
+                                                 : "argument must be real",
+                         std::move(nonreal_args));
 }
 
-void check_real(func_args args) {
+std::optional<func_error> nonreal_failure(func_args args) {
   std::vector<std::size_t> nonreal_args;
   for (std::ptrdiff_t i = 0; i < args.size(); i++) {
     if (args[i].imag() != 0) {
       nonreal_args.push_back(i);
     }
   }
-  throw_if_nonreal(std::move(nonreal_args));
+  return nonreal_failure(std::move(nonreal_args));
+}
+
+void throw_if_nonreal(std::vector<std::size_t> nonreal_args) {
+  if (auto err = nonreal_failure(std::move(nonreal_args))) {
+    err->raise();
+  }
+}
+
+void check_real(func_args args) {
+  if (auto err = nonreal_failure(args)) {
+    err->raise();
+  }
 }
 
 } // namespace ast_ops::impl
\ No newline at end of file
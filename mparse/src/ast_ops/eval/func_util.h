@@ -1,20 +1,50 @@
 #pragma once
 
+#include "ast_ops/eval/eval_error.h"
 #include "ast_ops/eval/types.h"
+#include "util/expected.h"
 #include "util/meta.h"
 #include <algorithm>
+#include <exception>
 #include <functional>
+#include <optional>
 #include <type_traits>
 #include <vector>
 
 namespace ast_ops {
+
+// Result of a function that reports failures as values. Builtins return these
+// rather than throwing, and functions wrapped by `wrap_try_function` never
+// throw.
+using func_result = util::expected<number, func_error>;
+using try_function = std::function<func_result(func_args)>;
+
 namespace impl {
 
+std::optional<func_error> arity_failure(std::size_t expected,
+                                        std::size_t provided);
 void check_arity(std::size_t expected, std::size_t provided);
 
+std::optional<func_error> nonreal_failure(
+    std::vector<std::size_t> nonreal_args);
+std::optional<func_error> nonreal_failure(func_args args);
 void throw_if_nonreal(std::vector<std::size_t> nonreal_args);
 void check_real(func_args args);
 
+// Returns the value of `res`, the result of a function that returns either a
+// plain value or a `func_result`, raising any failure it reports.
+template <typename R>
+number unwrap_func_result(const R& res) {
+  if constexpr (std::is_same_v<R, func_result>) {
+    if (!res) {
+      res.error().raise();
+    }
+    return *res;
+  } else {
+    return res;
+  }
+}
+
 template <typename F>
 struct get_memfun_args;
 
@@ -51,46 +81,87 @@ struct arg_checker<double> {
 
 
 template <std::size_t... I, typename... Args>
-void check_types(func_args args, std::index_sequence<I...>,
-                 util::type_list<Args...>) {
+std::optional<func_error> type_failure(func_args args,
+                                       std::index_sequence<I...>,
+                                       util::type_list<Args...>) {
   std::vector<std::size_t> nonreal_args;
   ((!arg_checker<Args>::check(args[I]) ? nonreal_args.push_back(I) : (void) 0),
    ...);
-  throw_if_nonreal(std::move(nonreal_args));
+  return nonreal_failure(std::move(nonreal_args));
+}
+
+template <typename F, std::size_t... I, typename... Args>
+func_result try_invoke_helper(F& func, func_args args,
+                              std::index_sequence<I...> idx,
+                              util::type_list<Args...> ts) {
+  if (auto err = arity_failure(sizeof...(Args), args.size())) {
+    return util::unexpected(std::move(*err));
+  }
+  if (auto err = type_failure(args, idx, ts)) {
+    return util::unexpected(std::move(*err));
+  }
+  return func(arg_checker<Args>::convert(args[I])...);
 }
 
 template <typename F, std::size_t... I, typename... Args>
 number invoke_helper(F& func, func_args args, std::index_sequence<I...> idx,
                      util::type_list<Args...> ts) {
-  check_arity(sizeof...(Args), args.size());
-  check_types(args, idx, ts);
-  return func(arg_checker<Args>::convert(args[I])...);
+  return unwrap_func_result(try_invoke_helper(func, args, idx, ts));
+}
+
+// Calls `func` with `args`, checking and converting them as its signature
+// requires. Failures of the checks, and any reported by `func` itself, are
+// returned.
+template <typename F>
+func_result try_invoke(F& func, func_args args) {
+  if constexpr (std::is_invocable_v<F&, func_args>) {
+    return func(args);
+  } else if constexpr (std::is_invocable_v<F&, real_func_args>) {
+    if (auto err = nonreal_failure(args)) {
+      return util::unexpected(std::move(*err));
+    }
+
+    std::vector<double> real_args;
+    std::transform(args.begin(), args.end(), std::back_inserter(real_args),
+                   [](const number& x) { return x.real(); });
+
+    return func(real_func_args(real_args));
+  } else {
+    using arg_types = get_args<std::decay_t<F>>;
+    return try_invoke_helper(func, args, typename arg_types::seq{},
+                             arg_types{});
+  }
 }
 
 } // namespace impl
 
 
+// Wraps `func`, taking any combination of numbers and doubles or a span of
+// either, as a `function` reporting failures by throwing.
 template <typename F>
 function wrap_function(F&& func) {
   if constexpr (std::is_convertible_v<F&&, function>) {
     return std::forward<F>(func);
-  } else if constexpr (std::is_convertible_v<F&&, real_function>) {
-    return [func = std::forward<F>(func)](func_args args) {
-      impl::check_real(args);
-
-      std::vector<double> real_args;
-      std::transform(args.begin(), args.end(), std::back_inserter(real_args),
-                     [](const number& x) { return x.real(); });
-
-      return func(real_args);
-    };
   } else {
-    return [func = std::forward<F>(func)](func_args args) {
-      using arg_types = impl::get_args<std::decay_t<F>>;
-      return impl::invoke_helper(func, args, typename arg_types::seq{},
-                                 arg_types{});
+    return [func = std::forward<F>(func)](func_args args) mutable {
+      return impl::unwrap_func_result(impl::try_invoke(func, args));
     };
   }
 }
 
+// Wraps `func` like `wrap_function`, but as a `try_function` that reports
+// failures as values. Exceptions thrown by `func` itself are reported as
+// `func_error::kind::other`.
+template <typename F>
+try_function wrap_try_function(F&& func) {
+  return [func = std::forward<F>(func)](
+             func_args args) mutable -> func_result {
+    try {
+      return impl::try_invoke(func, args);
+    } catch (...) {
+      return util::unexpected(func_error::exception(std::current_exception()));
+    }
+  };
+}
+
 } // namespace ast_ops
\ No newline at end of file
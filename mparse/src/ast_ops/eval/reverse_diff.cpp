@@ -0,0 +1,276 @@
+#include "reverse_diff.h"
+
+#include "ast_ops/eval/eval.h"
+#include "ast_ops/eval/eval_error.h"
+#include "ast_ops/eval/eval_ops.h"
+#include "mparse/traversal.h"
+#include <algorithm>
+#include <map>
+#include <stdexcept>
+#include <string>
+
+namespace ast_ops {
+
+class diff_tape::recorder : public mparse::const_ast_visitor<recorder>,
+                            public mparse::ast_traversal<recorder> {
+public:
+  recorder(diff_tape& tape, const func_scope& fscope)
+      : tape_(tape), fscope_(fscope) {}
+
+  // Whether all functions were found. If not, nothing useful was recorded.
+  bool complete() const { return complete_; }
+
+  void enter(const mparse::ast_node& node) {
+    auto* func_node = mparse::ast_node_cast<const mparse::func_node>(&node);
+    if (!func_node) {
+      return;
+    }
+
+    auto* func = fscope_.lookup(func_node->name());
+    complete_ = complete_ && func;
+
+    tape_.funcs_.push_back({func, find_func_diff_rule(func_node->name(), func),
+                            func_node->name()});
+    func_indices_.push_back(tape_.funcs_.size() - 1);
+  }
+
+  void leave(const mparse::ast_node& node) {
+    mparse::apply_visitor(*this, node);
+  }
+
+  void operator()(const mparse::abs_node& node) {
+    add_entry({.type = op_type::abs, .node = &node}, 1);
+  }
+
+  void operator()(const mparse::unary_op_node& node) {
+    // unary plus does nothing, and is not recorded
+    if (node.type() == mparse::unary_op_type::neg) {
+      add_entry({.type = op_type::neg, .node = &node}, 1);
+    }
+  }
+
+  void operator()(const mparse::binary_op_node& node) {
+    add_entry(
+        {.type = op_type::binary_op, .binary_type = node.type(), .node = &node},
+        2);
+  }
+
+  void operator()(const mparse::func_node& node) {
+    std::size_t func_idx = func_indices_.back();
+    func_indices_.pop_back();
+
+    add_entry({.type = op_type::func, .index = func_idx, .node = &node},
+              node.args().size());
+  }
+
+  void operator()(const mparse::literal_node& node) {
+    add_entry({.type = op_type::literal, .val = node.val(), .node = &node}, 0);
+  }
+
+  void operator()(const mparse::id_node& node) {
+    auto [it, inserted] =
+        var_slots_.try_emplace(node.name(), tape_.vars_.size());
+    if (inserted) {
+      tape_.vars_.push_back(node.name());
+    }
+
+    add_entry({.type = op_type::var, .index = it->second, .node = &node}, 0);
+  }
+
+private:
+  // Adds `ent`, whose operands are the topmost `operand_count` pending
+  // results.
+  void add_entry(entry ent, std::size_t operand_count) {
+    ent.varies = ent.type == op_type::var;
+    ent.first_operand = static_cast<std::uint32_t>(tape_.operands_.size());
+    ent.operand_count = static_cast<std::uint32_t>(operand_count);
+
+    auto first = pending_.end() - operand_count;
+    for (auto it = first; it != pending_.end(); ++it) {
+      ent.varies = ent.varies || tape_.entries_[*it].varies;
+      tape_.operands_.push_back(*it);
+    }
+    pending_.erase(first, pending_.end());
+
+    pending_.push_back(static_cast<std::uint32_t>(tape_.entries_.size()));
+    tape_.entries_.push_back(ent);
+  }
+
+  diff_tape& tape_;
+  const func_scope& fscope_;
+  bool complete_ = true;
+
+  // entries whose results have not been used yet
+  std::vector<std::uint32_t> pending_;
+
+  // functions of the `func_node`s currently being recorded
+  std::vector<std::size_t> func_indices_;
+
+  std::map<std::string_view, std::size_t, std::less<>> var_slots_;
+};
+
+
+diff_tape::diff_tape(const mparse::ast_node& node, const var_scope& vscope,
+                     const func_scope& fscope) {
+  recorder rec(*this, fscope);
+  mparse::traverse(rec, node);
+
+  if (!rec.complete()) {
+    // Report whichever error evaluation would have run into first.
+    ast_ops::eval(node, vscope, fscope);
+  }
+
+  eval(vscope);
+}
+
+void diff_tape::bind(const var_scope& vscope) {
+  bindings_.resize(vars_.size());
+  for (std::size_t i = 0; i < vars_.size(); i++) {
+    bindings_[i] = vscope.find(vars_[i]);
+  }
+  bound_ = true;
+}
+
+number diff_tape::eval() {
+  if (!bound_) {
+    throw std::logic_error("Tape has no variables bound");
+  }
+
+  valid_ = false;
+  values_.resize(entries_.size());
+
+  for (std::size_t i = 0; i < entries_.size(); i++) {
+    eval_entry(i);
+  }
+
+  valid_ = true;
+  return values_.back();
+}
+
+number diff_tape::value() const {
+  if (!valid_) {
+    throw std::logic_error("Tape has not been evaluated successfully");
+  }
+  return values_.back();
+}
+
+std::vector<number> diff_tape::gradient() {
+  if (!valid_) {
+    throw std::logic_error("Tape has not been evaluated successfully");
+  }
+
+  std::vector<number> grad(vars_.size());
+
+  adjoints_.assign(entries_.size(), partial{0, 0});
+  adjoints_.back() = {1, 0};
+
+  for (std::size_t i = entries_.size(); i-- > 0;) {
+    const entry& ent = entries_[i];
+    const partial& adjoint = adjoints_[i];
+
+    if (!ent.varies || (adjoint.d == 0.0 && adjoint.d_conj == 0.0)) {
+      continue;
+    }
+
+    const std::uint32_t* operands = operands_.data() + ent.first_operand;
+    partials_.resize(ent.operand_count);
+
+    switch (ent.type) {
+    case op_type::abs:
+      partials_[0] = abs_partial(values_[operands[0]]);
+      break;
+    case op_type::neg:
+      partials_[0] = unary_op_partial(mparse::unary_op_type::neg);
+      break;
+    case op_type::binary_op: {
+      auto [lhs_partial, rhs_partial] =
+          binary_op_partials(ent.binary_type, values_[operands[0]],
+                             values_[operands[1]], values_[i]);
+      partials_[0] = lhs_partial;
+      partials_[1] = rhs_partial;
+      break;
+    }
+    case op_type::func: {
+      const func_entry& func = funcs_[ent.index];
+      if (!func.rule) {
+        throw eval_error("Function '" + std::string(func.name) +
+                             "' has no derivative",
+                         eval_errc::no_derivative, ent.node);
+      }
+
+      func.rule(gather_args(ent), values_[i], partials_);
+      break;
+    }
+    case op_type::literal:
+      break;
+    case op_type::var:
+      // only real changes of variables are considered
+      grad[ent.index] += adjoint.d + adjoint.d_conj;
+      break;
+    }
+
+    for (std::size_t j = 0; j < ent.operand_count; j++) {
+      if (!entries_[operands[j]].varies) {
+        continue;
+      }
+
+      partial contrib = chain_partials(adjoint, partials_[j]);
+      if (!impl::is_finite(contrib.d) || !impl::is_finite(contrib.d_conj)) {
+        throw eval_error("Derivative not finite", eval_errc::no_derivative,
+                         ent.node);
+      }
+
+      partial& operand_adjoint = adjoints_[operands[j]];
+      operand_adjoint.d += contrib.d;
+      operand_adjoint.d_conj += contrib.d_conj;
+    }
+  }
+
+  return grad;
+}
+
+
+void diff_tape::eval_entry(std::size_t idx) {
+  const entry& ent = entries_[idx];
+  const std::uint32_t* operands = operands_.data() + ent.first_operand;
+  number& ret = values_[idx];
+
+  switch (ent.type) {
+  case op_type::abs:
+    ret = impl::eval_abs(values_[operands[0]], ent.node);
+    break;
+  case op_type::neg:
+    ret = impl::eval_unary_op(mparse::unary_op_type::neg, values_[operands[0]],
+                              ent.node);
+    break;
+  case op_type::binary_op:
+    ret = impl::eval_binary_op(ent.binary_type, values_[operands[0]],
+                               values_[operands[1]], ent.node);
+    break;
+  case op_type::func: {
+    const func_entry& func = funcs_[ent.index];
+    func_args args = gather_args(ent);
+    ret = impl::call_func([&] { return (*func.func)(args); }, func.name,
+                          ent.node);
+    break;
+  }
+  case op_type::literal:
+    ret = impl::eval_literal(ent.val, ent.node);
+    break;
+  case op_type::var:
+    ret = impl::eval_binding(bindings_[ent.index], vars_[ent.index], ent.node);
+    break;
+  }
+}
+
+util::span<const number> diff_tape::gather_args(const entry& ent) {
+  const std::uint32_t* operands = operands_.data() + ent.first_operand;
+
+  args_.resize(ent.operand_count);
+  for (std::size_t i = 0; i < ent.operand_count; i++) {
+    args_[i] = values_[operands[i]];
+  }
+  return args_;
+}
+
+} // namespace ast_ops
\ No newline at end of file
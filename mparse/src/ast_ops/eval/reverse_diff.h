@@ -0,0 +1,110 @@
+#pragma once
+
+#include "ast_ops/eval/diff_rules.h"
+#include "ast_ops/eval/scope.h"
+#include "ast_ops/eval/types.h"
+#include "mparse/ast.h"
+#include "util/span.h"
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace ast_ops {
+
+// Operations of an expression recorded in evaluation order, for computing its
+// gradient with respect to all of its variables in one backward sweep
+// (reverse-mode automatic differentiation). Once recorded, the tape can be
+// re-evaluated with new variable values as long as the tree does not change.
+//
+// Derivatives follow the same conventions as `eval_forward_diff`. The tree and
+// function scope must outlive the tape, which is not safe to use from several
+// threads at once.
+class diff_tape {
+public:
+  // Evaluates `node` like `eval`, with the same errors, recording it. Binds
+  // `vscope` as `eval(vscope)` does.
+  diff_tape(const mparse::ast_node& node, const var_scope& vscope,
+            const func_scope& fscope);
+
+  // Variables of the expression, in order of first appearance. These include
+  // any constants it refers to, such as `pi`.
+  const std::vector<std::string_view>& vars() const { return vars_; }
+
+  // Resolves the variables of the tape against `vscope` once, so that `eval()`
+  // reads their bindings directly. `vscope` must not be modified or destroyed
+  // while bound; bindings made with `var_scope::set_binding_ref` still yield
+  // the current value of the host variable on each evaluation.
+  void bind(const var_scope& vscope);
+
+  // Re-evaluates the recorded operations with the variables last bound.
+  number eval();
+
+  number eval(const var_scope& vscope) {
+    bind(vscope);
+    return eval();
+  }
+
+  // Result of the last evaluation. Throws `std::logic_error` if that
+  // evaluation failed, as nothing meaningful was computed.
+  number value() const;
+
+  // Partial derivatives of the last evaluation with respect to each of
+  // `vars()`. Throws `std::logic_error` if that evaluation failed.
+  std::vector<number> gradient();
+
+private:
+  enum class op_type : std::uint8_t {
+    abs,
+    neg,
+    binary_op,
+    func,
+    literal,
+    var,
+  };
+
+  struct entry {
+    op_type type;
+    mparse::binary_op_type binary_type = {}; // binary operators only
+    bool varies = false; // whether the result depends on any variable
+
+    // operands are `operands_[first_operand, first_operand + operand_count)`
+    std::uint32_t first_operand = 0;
+    std::uint32_t operand_count = 0;
+
+    std::size_t index = 0; // function in `funcs_`, or variable in `vars_`
+    double val = 0;        // literals only
+
+    const mparse::ast_node* node = nullptr;
+  };
+
+  struct func_entry {
+    const function* func;
+    func_diff_rule rule;
+    std::string_view name;
+  };
+
+  class recorder;
+
+  void eval_entry(std::size_t idx);
+  util::span<const number> gather_args(const entry& ent);
+
+  std::vector<entry> entries_;
+  std::vector<std::uint32_t> operands_;
+  std::vector<func_entry> funcs_;
+  std::vector<std::string_view> vars_;
+
+  std::vector<const var_scope::binding*> bindings_; // of `vars_`
+  bool bound_ = false;
+
+  // per-evaluation state
+  std::vector<number> values_;
+  bool valid_ = false;
+
+  // scratch space
+  std::vector<number> args_;
+  std::vector<partial> partials_;
+  std::vector<partial> adjoints_; // partials of the result w.r.t. each entry
+};
+
+} // namespace ast_ops
\ No newline at end of file
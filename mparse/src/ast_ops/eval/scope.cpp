@@ -1,68 +1,185 @@
 #include "scope.h"
 
+#include <vector>
+
 namespace ast_ops {
 
+namespace impl {
+
+template <typename Scope>
+Scope snapshot_scope(const Scope& scope) {
+  using impl_type = typename Scope::impl_type;
+
+  // scopes whose bindings are merged, nearest first
+  std::vector<const Scope*> chain;
+  const Scope* cur = &scope;
+  for (; cur; cur = cur->parent_) {
+    chain.push_back(cur);
+    if (cur->table_) {
+      break;
+    }
+  }
+
+  Scope ret;
+  if (cur) {
+    ret.table_ = cur->table_;
+    ret.parent_ = cur->parent_;
+  }
+
+  std::vector<const util::cow_ptr<impl_type>*> maps;
+  std::size_t total_size = 0;
+  for (const Scope* link : chain) {
+    if (link->map_ && !link->map_->empty()) {
+      maps.push_back(&link->map_);
+      total_size += link->map_->size();
+    }
+  }
+
+  if (maps.size() == 1) {
+    // nothing to merge; share the bindings
+    ret.map_ = *maps.front();
+  } else if (!maps.empty()) {
+    impl_type& merged = ret.map_.own();
+    merged.reserve(total_size);
+    for (auto it = maps.rbegin(); it != maps.rend(); ++it) {
+      const impl_type& map = ***it;
+      for (const auto& [name, val] : map) {
+        merged.insert_or_assign(name, val);
+      }
+    }
+  }
+
+  return ret;
+}
+
+} // namespace impl
+
+
+number var_scope::binding::get() const {
+  if (auto* ref = std::get_if<const double*>(&val_)) {
+    return **ref;
+  }
+  if (auto* ref = std::get_if<const number*>(&val_)) {
+    return **ref;
+  }
+  return std::get<number>(val_);
+}
+
+
 var_scope::var_scope(const var_scope* parent) : parent_(parent) {}
 
+var_scope::var_scope(table_lookup table) : table_(table) {}
+
 var_scope::var_scope(std::initializer_list<impl_type::value_type> ilist)
-    : map_(ilist) {}
+    : map_(std::make_shared<impl_type>(ilist)) {}
 
 var_scope::var_scope(const var_scope* parent,
                      std::initializer_list<impl_type::value_type> ilist)
-    : map_(ilist), parent_(parent) {}
+    : map_(std::make_shared<impl_type>(ilist)), parent_(parent) {}
 
 void var_scope::set_binding(std::string name, number value) {
-  map_[std::move(name)] = value;
+  map_.own().insert_or_assign(std::move(name), value);
+}
+
+void var_scope::set_binding_ref(std::string name, const double* ref) {
+  map_.own().insert_or_assign(std::move(name), binding(ref));
+}
+
+void var_scope::set_binding_ref(std::string name, const number* ref) {
+  map_.own().insert_or_assign(std::move(name), binding(ref));
 }
 
 void var_scope::remove_binding(std::string_view name) {
-  auto it = map_.find(name);
-  if (it != map_.end()) {
-    map_.erase(it);
+  if (map_ && map_->find(name)) {
+    map_.own().erase(name);
   }
 }
 
 std::optional<number> var_scope::lookup(std::string_view name) const {
-  auto it = map_.find(name);
-  if (it != map_.end()) {
-    return it->second;
+  if (auto* val = find(name)) {
+    return val->get();
   }
+  return std::nullopt;
+}
 
-  if (parent_) {
-    return parent_->lookup(name);
+const var_scope::binding* var_scope::find(std::string_view name) const {
+  return find(util::hashed_string(name));
+}
+
+const var_scope::binding* var_scope::find(
+    const util::hashed_string& name) const {
+  for (const var_scope* scope = this; scope; scope = scope->parent_) {
+    if (scope->map_) {
+      if (auto* val = scope->map_->find(name)) {
+        return val;
+      }
+    }
+    if (scope->table_) {
+      if (auto* val = scope->table_(name.str)) {
+        return val;
+      }
+    }
   }
-  return std::nullopt;
+  return nullptr;
+}
+
+var_scope var_scope::snapshot() const {
+  return impl::snapshot_scope(*this);
 }
 
 
 func_scope::func_scope(const func_scope* parent) : parent_(parent) {}
 
+func_scope::func_scope(table_lookup table) : table_(table) {}
+
 func_scope::func_scope(std::initializer_list<impl_type::value_type> ilist)
-    : map_(ilist) {}
+    : map_(std::make_shared<impl_type>(ilist)) {}
 
 func_scope::func_scope(const func_scope* parent,
                        std::initializer_list<impl_type::value_type> ilist)
-    : map_(ilist), parent_(parent) {}
+    : map_(std::make_shared<impl_type>(ilist)), parent_(parent) {}
 
 void func_scope::set_binding(std::string name, func_wrapper func) {
-  map_.insert_or_assign(std::move(name), std::move(func));
+  map_.own().insert_or_assign(std::move(name), std::move(func));
 }
 
 void func_scope::remove_binding(std::string_view name) {
-  auto it = map_.find(name);
-  if (it != map_.end()) {
-    map_.erase(it);
+  if (map_ && map_->find(name)) {
+    map_.own().erase(name);
   }
 }
 
 const function* func_scope::lookup(std::string_view name) const {
-  auto it = map_.find(name);
-  if (it != map_.end()) {
-    return &it->second.func;
+  if (auto* wrapper = find(name)) {
+    return &wrapper->func;
+  }
+  return nullptr;
+}
+
+const try_function* func_scope::try_lookup(std::string_view name) const {
+  if (auto* wrapper = find(name)) {
+    return &wrapper->try_func;
   }
+  return nullptr;
+}
+
+func_scope func_scope::snapshot() const {
+  return impl::snapshot_scope(*this);
+}
 
-  if (parent_) {
-    return parent_->lookup(name);
+auto func_scope::find(std::string_view name) const -> const func_wrapper* {
+  util::hashed_string hashed(name);
+  for (const func_scope* scope = this; scope; scope = scope->parent_) {
+    if (scope->map_) {
+      if (auto* wrapper = scope->map_->find(hashed)) {
+        return wrapper;
+      }
+    }
+    if (scope->table_) {
+      if (auto* wrapper = scope->table_(name)) {
+        return wrapper;
+      }
+    }
   }
   return nullptr;
 }
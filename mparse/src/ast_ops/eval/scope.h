@@ -3,55 +3,127 @@
 #include "ast_ops/eval/eval_error.h"
 #include "ast_ops/eval/func_util.h"
 #include "ast_ops/eval/types.h"
+#include "util/cow_ptr.h"
+#include "util/hash_string.h"
+#include "util/string_map.h"
 #include <initializer_list>
-#include <map>
+#include <memory>
 #include <optional>
 #include <string>
 #include <string_view>
 #include <type_traits>
+#include <variant>
 
 namespace ast_ops {
 
+namespace impl {
+
+// Implements `snapshot` for both kinds of scopes.
+template <typename Scope>
+Scope snapshot_scope(const Scope& scope);
+
+} // namespace impl
+
+
+// Scopes map names to bindings, falling back to their parents for names they
+// lack. Copies of a scope share its bindings until either is modified, so a
+// snapshot can be copied cheaply for each of many concurrent evaluations.
+
 class var_scope {
-  using impl_type = std::map<std::string, number, std::less<>>;
+public:
+  // Value of a variable, either stored in the scope or read from host memory
+  // each time it is looked up.
+  class binding {
+  public:
+    constexpr binding(number val) : val_(val) {}
+    constexpr explicit binding(const double* ref) : val_(ref) {}
+    constexpr explicit binding(const number* ref) : val_(ref) {}
+
+    number get() const;
+
+  private:
+    std::variant<number, const double*, const number*> val_;
+  };
+
+  // Resolves names missing from a scope's own bindings, before its parent
+  // does. Lets immutable tables, such as the builtins, serve as scopes.
+  using table_lookup = const binding* (*)(std::string_view name);
+
+private:
+  using impl_type = util::string_map<binding>;
 
 public:
   var_scope() = default;
   explicit var_scope(const var_scope* parent);
+  explicit var_scope(table_lookup table);
 
   var_scope(std::initializer_list<impl_type::value_type> ilist);
   var_scope(const var_scope* parent,
             std::initializer_list<impl_type::value_type> ilist);
 
   void set_binding(std::string name, number val);
+
+  // Binds `name` to the value at `ref`, which must outlive the binding. The
+  // current value is read whenever the variable is evaluated, so the binding
+  // need not be updated when it changes.
+  void set_binding_ref(std::string name, const double* ref);
+  void set_binding_ref(std::string name, const number* ref);
+
   void remove_binding(std::string_view name);
 
   const var_scope* parent() const { return parent_; }
   void set_parent(const var_scope* parent) { parent_ = parent; }
 
-  void clear() { map_.clear(); }
+  void clear() { map_.reset(); }
 
   std::optional<number> lookup(std::string_view name) const;
 
+  // Returns the binding of `name`, for callers that resolve a variable once
+  // and read it repeatedly; it remains valid until the scope holding it is
+  // modified.
+  const binding* find(std::string_view name) const;
+  const binding* find(const util::hashed_string& name) const;
+
+  // Returns a scope holding every binding visible from this one, so that
+  // lookups need not walk the chain. Scopes backed by tables are immutable, so
+  // the chain is only flattened up to the first of them, whose table and
+  // parent are shared by the snapshot.
+  var_scope snapshot() const;
+
 private:
-  impl_type map_;
+  util::cow_ptr<impl_type> map_;
+  table_lookup table_ = nullptr;
   const var_scope* parent_ = nullptr;
+
+  template <typename Scope>
+  friend Scope impl::snapshot_scope(const Scope& scope);
 };
 
 
 class func_scope {
+public:
+  // Every function is kept both throwing and reporting failures as values,
+  // for `eval` and `try_eval` respectively.
   struct func_wrapper {
     template <typename F>
-    func_wrapper(F&& func) : func(wrap_function(std::forward<F>(func))) {}
+    func_wrapper(F&& func)
+        : func(wrap_function(func)),
+          try_func(wrap_try_function(std::forward<F>(func))) {}
 
     function func;
+    try_function try_func;
   };
 
-  using impl_type = std::map<std::string, func_wrapper, std::less<>>;
+  // See `var_scope::table_lookup`.
+  using table_lookup = const func_wrapper* (*)(std::string_view name);
+
+private:
+  using impl_type = util::string_map<func_wrapper>;
 
 public:
   func_scope() = default;
   explicit func_scope(const func_scope* parent);
+  explicit func_scope(table_lookup table);
 
   func_scope(std::initializer_list<impl_type::value_type> ilist);
   func_scope(const func_scope* parent,
@@ -63,13 +135,23 @@ public:
   const func_scope* parent() const { return parent_; }
   void set_parent(const func_scope* parent) { parent_ = parent; }
 
-  void clear() { map_.clear(); }
+  void clear() { map_.reset(); }
 
   const function* lookup(std::string_view name) const;
+  const try_function* try_lookup(std::string_view name) const;
+
+  // See `var_scope::snapshot`.
+  func_scope snapshot() const;
 
 private:
-  impl_type map_;
+  const func_wrapper* find(std::string_view name) const;
+
+  util::cow_ptr<impl_type> map_;
+  table_lookup table_ = nullptr;
   const func_scope* parent_ = nullptr;
+
+  template <typename Scope>
+  friend Scope impl::snapshot_scope(const Scope& scope);
 };
 
 } // namespace ast_ops
\ No newline at end of file
@@ -0,0 +1,68 @@
+#include "specialize.h"
+
+#include <cstring>
+#include <optional>
+#include <unordered_set>
+#include <utility>
+
+namespace ast_ops {
+
+compiled_expr specialize(mparse::ast_node_ptr node, const var_scope& known) {
+  return compiled_expr(std::move(node), &known);
+}
+
+
+specialization_cache::specialization_cache(mparse::ast_node_ptr node)
+    : node_(std::move(node)) {
+  std::unordered_set<std::string_view> seen;
+  std::unordered_set<const mparse::ast_node*> visited_shared;
+  std::vector<const mparse::ast_node*> stack = {node_.get()};
+
+  while (!stack.empty()) {
+    const mparse::ast_node* cur = stack.back();
+    stack.pop_back();
+
+    if (auto* id = mparse::ast_node_cast<const mparse::id_node>(cur)) {
+      if (seen.insert(id->name()).second) {
+        vars_.push_back(id->name());
+      }
+      continue;
+    }
+
+    for (auto i = mparse::child_count(*cur); i-- > 0;) {
+      const auto& child = mparse::get_child_slot(*cur, i);
+      if (child.use_count() == 1 || visited_shared.insert(child.get()).second) {
+        stack.push_back(child.get());
+      }
+    }
+  }
+}
+
+std::shared_ptr<const compiled_expr> specialization_cache::get(
+    const var_scope& known) {
+  // Values are compared bitwise, so that NaNs hit the cache as well and signed
+  // zeros (which can evaluate differently) do not.
+  std::string key;
+  var_scope relevant;
+
+  for (std::string_view var : vars_) {
+    std::optional<number> val = known.lookup(var);
+    key.push_back(val.has_value());
+
+    if (val) {
+      char bytes[sizeof(number)];
+      std::memcpy(bytes, &*val, sizeof(number));
+      key.append(bytes, sizeof(bytes));
+
+      relevant.set_binding(std::string(var), *val);
+    }
+  }
+
+  auto& ret = cache_[std::move(key)];
+  if (!ret) {
+    ret = std::make_shared<const compiled_expr>(specialize(node_, relevant));
+  }
+  return ret;
+}
+
+} // namespace ast_ops
\ No newline at end of file
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "ast_ops/eval/compile.h"
+#include "ast_ops/eval/scope.h"
+#include "mparse/ast.h"
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace ast_ops {
+
+// Compiles `node` with the variables bound in `known` treated as constants:
+// every subtree depending only on them, literals and builtin functions is
+// computed once here, so that evaluation only does the work depending on the
+// remaining variables. Subtrees that would fail raise the same error when the
+// result is evaluated, in the same order `eval` would.
+//
+// The result must be evaluated with a function scope in which the builtin
+// functions are not overridden. Its variable scope need not bind the known
+// variables, and any bindings it has for them are ignored.
+compiled_expr specialize(mparse::ast_node_ptr node, const var_scope& known);
+
+
+// Specializations of a single expression, cached by the values of the known
+// variables it refers to (bindings of other variables do not matter). Not
+// safe to use from several threads at once, but the specializations returned
+// are.
+class specialization_cache {
+public:
+  explicit specialization_cache(mparse::ast_node_ptr node);
+
+  // Returns the expression specialized for `known`, specializing it if these
+  // values have not been seen before.
+  std::shared_ptr<const compiled_expr> get(const var_scope& known);
+
+  void clear() { cache_.clear(); }
+
+private:
+  mparse::ast_node_ptr node_;
+
+  // variables of the expression, in order of first appearance
+  std::vector<std::string_view> vars_;
+
+  // keyed by the representation of the known values of `vars_`
+  std::unordered_map<std::string, std::shared_ptr<const compiled_expr>>
+      cache_;
+};
+
+} // namespace ast_ops
\ No newline at end of file
@@ -0,0 +1,167 @@
+#pragma once
+
+#include "ast_ops/eval/builtins.h"
+#include "ast_ops/eval/eval_ops.h"
+#include "ast_ops/eval/func_util.h"
+#include "ast_ops/eval/types.h"
+#include "mparse/static_parser.h"
+#include "util/fixed_string.h"
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace ast_ops {
+namespace impl {
+
+constexpr std::size_t find_builtin_var(std::string_view name) {
+  return builtin_var_names.find(name);
+}
+
+constexpr std::size_t builtin_func_count =
+    std::tuple_size_v<std::remove_const_t<decltype(builtin_funcs)>>;
+
+constexpr std::size_t find_builtin_func(std::string_view name) {
+  return builtin_func_names.find(name);
+}
+
+
+template <typename Expr>
+constexpr auto collect_static_vars() {
+  constexpr const auto& tree = Expr::tree;
+
+  std::array<std::string_view, tree.node_count> names{};
+  std::size_t count = 0;
+
+  for (std::size_t i = 0; i < tree.node_count; i++) {
+    const mparse::static_node& node = tree.nodes[i];
+    if (node.type != mparse::static_node_type::id ||
+        find_builtin_var(node.name) < builtin_vars.size()) {
+      continue;
+    }
+
+    auto end = names.begin() + count;
+    if (std::find(names.begin(), end, node.name) == end) {
+      names[count++] = node.name;
+    }
+  }
+
+  return std::pair{names, count};
+}
+
+} // namespace impl
+
+
+// Free variables of the static expression `Expr`, in order of first appearance.
+// Builtin constants are not included.
+template <typename Expr>
+constexpr auto static_vars = [] {
+  constexpr auto collected = impl::collect_static_vars<Expr>();
+
+  std::array<std::string_view, collected.second> vars{};
+  std::copy_n(collected.first.begin(), collected.second, vars.begin());
+  return vars;
+}();
+
+
+namespace impl {
+
+template <typename Expr>
+constexpr std::size_t static_var_index(std::string_view name) {
+  constexpr const auto& vars = static_vars<Expr>;
+  return std::find(vars.begin(), vars.end(), name) - vars.begin();
+}
+
+// Calls a builtin with the same argument checks as `wrap_function`, except that
+// the number of arguments is checked at compile time where possible.
+template <typename F, std::size_t N>
+number invoke_builtin(F* func, const std::array<number, N>& args) {
+  func_args arg_span(args.data(), N);
+
+  if constexpr (std::is_invocable_v<F*, func_args>) {
+    return unwrap_func_result(func(arg_span));
+  } else if constexpr (std::is_invocable_v<F*, real_func_args>) {
+    check_real(arg_span);
+
+    std::array<double, N> real_args;
+    std::transform(args.begin(), args.end(), real_args.begin(),
+                   [](const number& x) { return x.real(); });
+    return unwrap_func_result(func(real_func_args(real_args.data(), N)));
+  } else {
+    using arg_types = get_args<F*>;
+    static_assert(arg_types::size == N,
+                  "Wrong number of arguments to builtin function");
+
+    return invoke_helper(func, arg_span, typename arg_types::seq{},
+                         arg_types{});
+  }
+}
+
+template <typename Expr, std::size_t Idx, std::size_t V>
+number eval_static_node(const std::array<number, V>& vars) {
+  constexpr const auto& tree = Expr::tree;
+  constexpr const mparse::static_node& node = tree.nodes[Idx];
+
+  using mparse::static_node_type;
+
+  if constexpr (node.type == static_node_type::paren) {
+    return eval_static_node<Expr, node.first_child>(vars);
+  } else if constexpr (node.type == static_node_type::abs) {
+    return eval_abs(eval_static_node<Expr, node.first_child>(vars), nullptr);
+  } else if constexpr (node.type == static_node_type::unary_op) {
+    return eval_unary_op(node.unary_type,
+                         eval_static_node<Expr, node.first_child>(vars),
+                         nullptr);
+  } else if constexpr (node.type == static_node_type::binary_op) {
+    number lhs_val = eval_static_node<Expr, node.first_child>(vars);
+    number rhs_val = eval_static_node<Expr, tree.child(Idx, 1)>(vars);
+    return eval_binary_op(node.binary_type, lhs_val, rhs_val, nullptr);
+  } else if constexpr (node.type == static_node_type::func) {
+    constexpr std::size_t func_idx = find_builtin_func(node.name);
+    static_assert(func_idx < builtin_func_count,
+                  "Static expressions may only call builtin functions");
+
+    constexpr std::size_t arg_count = node.child_count;
+    constexpr auto* func = std::get<func_idx>(builtin_funcs).func;
+
+    auto args = [&]<std::size_t... I>(std::index_sequence<I...>) {
+      return std::array<number, arg_count>{
+          eval_static_node<Expr, Expr::tree.child(Idx, I)>(vars)...};
+    }(std::make_index_sequence<arg_count>{});
+
+    return call_func([&] { return invoke_builtin(func, args); }, node.name,
+                     nullptr);
+  } else if constexpr (node.type == static_node_type::literal) {
+    return node.val;
+  } else {
+    constexpr std::size_t builtin_idx = find_builtin_var(node.name);
+
+    if constexpr (builtin_idx < builtin_vars.size()) {
+      return builtin_vars[builtin_idx].val;
+    } else {
+      constexpr std::size_t var_idx = static_var_index<Expr>(node.name);
+      return check_range([&] { return vars[var_idx]; }, nullptr);
+    }
+  }
+}
+
+} // namespace impl
+
+
+// Evaluates a static expression, given the values of its variables in the
+// order of `static_vars`. Builtin constants and functions are bound at compile
+// time, so that the evaluation can be inlined completely. Errors carry no node.
+template <util::fixed_string Source, typename... Args>
+number eval(const mparse::static_expr<Source>&, const Args&... vals) {
+  using expr_type = mparse::static_expr<Source>;
+  static_assert(sizeof...(Args) == static_vars<expr_type>.size(),
+                "Expected one value per variable of the expression");
+
+  std::array<number, sizeof...(Args)> vars = {number(vals)...};
+  return impl::eval_static_node<expr_type, expr_type::tree.root()>(vars);
+}
+
+} // namespace ast_ops
\ No newline at end of file
@@ -0,0 +1,116 @@
+#include "build.h"
+
+#include "mparse/ast.h"
+#include <type_traits>
+
+namespace ast_ops::matching {
+
+void node_pool::recycle(mparse::ast_node_ptr root) {
+  // Bounded, so that no allocation is needed; whatever doesn't fit is left
+  // alone, being held by the journal.
+  std::array<mparse::ast_node_ptr, 2 * max_nodes_per_type> pending;
+  std::size_t pending_count = 0;
+
+  root_ = root;
+  pending[pending_count++] = std::move(root);
+
+  while (pending_count > 0) {
+    mparse::ast_node_ptr node = std::move(pending[--pending_count]);
+    std::size_t children = mparse::child_count(*node);
+
+    // Every pending node is also held by the journal, either as the root or as
+    // the saved child of a recycled node.
+    if (node.use_count() != 2 || pending.size() - pending_count < children ||
+        !try_add(node)) {
+      continue;
+    }
+
+    for (std::size_t i = 0; i < children; i++) {
+      if (auto& child = mparse::get_child_slot(*node, i)) {
+        pending[pending_count++] = std::move(child);
+      }
+    }
+  }
+}
+
+
+mparse::ast_node_ptr node_pool::restore() {
+  for (std::size_t i = 0; i < saved_count_; i++) {
+    saved_node& saved = saved_[i];
+    mparse::ast_node& node = *saved.node;
+
+    for (std::size_t j = 0; j < mparse::child_count(node); j++) {
+      mparse::get_child_slot(node, j) = std::move(saved.children[j]);
+    }
+
+    if (auto* binary = mparse::ast_node_cast<mparse::binary_op_node>(&node)) {
+      binary->set_type(saved.binary_type);
+    } else if (auto* unary =
+                   mparse::ast_node_cast<mparse::unary_op_node>(&node)) {
+      unary->set_type(saved.unary_type);
+    } else if (auto* literal =
+                   mparse::ast_node_cast<mparse::literal_node>(&node)) {
+      literal->set_val(saved.val);
+    }
+  }
+
+  mparse::ast_node_ptr root = std::move(root_);
+  commit();
+  return root;
+}
+
+void node_pool::commit() {
+  for (std::size_t i = 0; i < saved_count_; i++) {
+    saved_[i] = {};
+  }
+  saved_count_ = 0;
+  root_.reset();
+}
+
+
+template <typename Node>
+bool node_pool::try_add_as(const mparse::ast_node_ptr& node) {
+  auto& slots = std::get<slots_for<Node>>(slots_);
+  if (slots.count == max_nodes_per_type) {
+    return false;
+  }
+
+  auto typed = mparse::static_ast_node_ptr_cast<Node>(node);
+
+  saved_node& saved = saved_[saved_count_++];
+  saved.node = node;
+  for (std::size_t i = 0; i < mparse::child_count(*node); i++) {
+    saved.children[i] = mparse::get_child_slot(*node, i);
+  }
+  if constexpr (std::is_same_v<Node, mparse::binary_op_node>) {
+    saved.binary_type = typed->type();
+  } else if constexpr (std::is_same_v<Node, mparse::unary_op_node>) {
+    saved.unary_type = typed->type();
+  } else if constexpr (std::is_same_v<Node, mparse::literal_node>) {
+    saved.val = typed->val();
+  }
+
+  slots.nodes[slots.count++] = std::move(typed);
+  return true;
+}
+
+bool node_pool::try_add(const mparse::ast_node_ptr& node) {
+  if (mparse::ast_node_cast<mparse::binary_op_node>(node.get())) {
+    return try_add_as<mparse::binary_op_node>(node);
+  }
+  if (mparse::ast_node_cast<mparse::unary_op_node>(node.get())) {
+    return try_add_as<mparse::unary_op_node>(node);
+  }
+  if (mparse::ast_node_cast<mparse::paren_node>(node.get())) {
+    return try_add_as<mparse::paren_node>(node);
+  }
+  if (mparse::ast_node_cast<mparse::abs_node>(node.get())) {
+    return try_add_as<mparse::abs_node>(node);
+  }
+  if (mparse::ast_node_cast<mparse::literal_node>(node.get())) {
+    return try_add_as<mparse::literal_node>(node);
+  }
+  return false;
+}
+
+} // namespace ast_ops::matching
\ No newline at end of file
@@ -1,10 +1,12 @@
 #pragma once
 
-#include "ast_ops/clone.h"
 #include "ast_ops/matching/expr.h"
 #include "ast_ops/matching/match_results.h"
 #include "mparse/ast.h"
 #include "util/meta.h"
+#include <array>
+#include <cstddef>
+#include <tuple>
 #include <utility>
 
 namespace ast_ops::matching {
@@ -15,76 +17,164 @@ struct builder_traits {
 };
 
 
-namespace impl {
+// Nodes freed by a rewrite, kept so that the builder can relink them instead of
+// allocating new ones.
+class node_pool {
+public:
+  // Dismantles the part of the tree rooted at `root` that is not shared with
+  // anything else, keeping (a bounded number of) its nodes for reuse. How the
+  // tree was linked is journaled, so that it can be put back together by
+  // `restore` should building fail, until `commit` drops the journal.
+  void recycle(mparse::ast_node_ptr root);
+
+  // Reassembles the recycled tree, returning its root. Nodes that were taken
+  // must no longer be in use.
+  mparse::ast_node_ptr restore();
+  void commit();
+
+  // Returns a node of type `Node` with its children detached, or null if none
+  // is available.
+  template <typename Node>
+  mparse::node_ptr<Node> take() {
+    if constexpr (is_pooled<Node>) {
+      auto& slots = std::get<slots_for<Node>>(slots_);
+      if (slots.count > 0) {
+        return std::move(slots.nodes[--slots.count]);
+      }
+    }
+    return nullptr;
+  }
 
-template <typename E, typename = void>
-struct get_build_tags {
-  using type = util::type_list<>;
-};
+  // Number of nodes currently available.
+  std::size_t size() const {
+    return std::apply(
+        [](const auto&... slots) { return (slots.count + ...); }, slots_);
+  }
 
-template <typename E>
-struct get_build_tags<E, std::void_t<typename builder_traits<E>::tags>> {
-  using type = typename builder_traits<E>::tags;
+private:
+  static constexpr std::size_t max_nodes_per_type = 4;
+
+  // Original children and contents of a recycled node.
+  struct saved_node {
+    mparse::ast_node_ptr node;
+    std::array<mparse::ast_node_ptr, 2> children;
+    mparse::unary_op_type unary_type{};
+    mparse::binary_op_type binary_type{};
+    double val = 0;
+  };
+
+  template <typename Node>
+  struct slots_for {
+    std::array<mparse::node_ptr<Node>, max_nodes_per_type> nodes;
+    std::size_t count = 0;
+  };
+
+  using pooled_types =
+      util::type_list<mparse::paren_node, mparse::abs_node,
+                      mparse::unary_op_node, mparse::binary_op_node,
+                      mparse::literal_node>;
+
+  template <typename Node>
+  static constexpr bool is_pooled = util::type_list_count_v<Node, pooled_types>;
+
+  template <typename Node>
+  bool try_add_as(const mparse::ast_node_ptr& node);
+  bool try_add(const mparse::ast_node_ptr& node);
+
+  std::tuple<slots_for<mparse::paren_node>, slots_for<mparse::abs_node>,
+             slots_for<mparse::unary_op_node>,
+             slots_for<mparse::binary_op_node>,
+             slots_for<mparse::literal_node>>
+      slots_;
+
+  std::array<saved_node, 5 * max_nodes_per_type> saved_;
+  std::size_t saved_count_ = 0;
+  mparse::ast_node_ptr root_;
 };
 
-template <typename E>
-using get_build_tags_t = typename get_build_tags<E>::type;
 
+namespace impl {
 
-template <typename BuildTags, typename Tag, typename Ctx>
+// Takes ownership of a capture consumed by the builder. Captures used several
+// times are shared between their uses rather than copied, as shared subtrees
+// are never modified in place (see `unshare`).
+template <typename Tag, typename Ctx>
 auto get_build_result(Ctx&& ctx) {
-  auto&& stored = get_result<Tag>(std::forward<Ctx>(ctx));
-
-  if constexpr ((util::type_list_count_v<Tag, BuildTags>) > 1) {
-    // used several times - clone for safety
-    return ast_ops::clone(stored.get());
-  } else {
-    // only required once - no need to copy
-    return std::forward<decltype(stored)>(stored);
-  }
+  return get_result<Tag>(std::forward<Ctx>(ctx)).to_owned();
 }
 
+
+// Whether building `E` can only fail by running out of memory, so that the
+// matched tree can be dismantled for parts before building.
+template <typename E>
+constexpr bool is_nothrow_builder = true;
+
+template <typename F, typename... Tags>
+constexpr bool is_nothrow_builder<custom_builder_expr<F, Tags...>> = false;
+
+template <typename... Args>
+constexpr bool is_nothrow_builder<func_expr<Args...>> =
+    (is_nothrow_builder<Args> && ...);
+
+template <typename Node, typename Inner>
+constexpr bool is_nothrow_builder<unary_expr<Node, Inner>> =
+    is_nothrow_builder<Inner>;
+
+template <typename Pred, typename Inner>
+constexpr bool is_nothrow_builder<unary_op_pred_expr<Pred, Inner>> =
+    is_nothrow_builder<Inner>;
+
+template <typename Pred, typename Lhs, typename Rhs, bool Commute>
+constexpr bool
+    is_nothrow_builder<binary_op_pred_expr<Pred, Lhs, Rhs, Commute>> =
+        is_nothrow_builder<Lhs> && is_nothrow_builder<Rhs>;
+
 } // namespace impl
 
 
 template <typename F, typename... Tags>
 struct builder_traits<custom_builder_expr<F, Tags...>> {
-  using tags = util::type_list<Tags...>;
 
-  template <typename BuildTags, typename Ctx>
-  static auto build(const custom_builder_expr<F, Tags...>& expr, Ctx&& ctx) {
-    return expr.func(
-        impl::get_build_result<BuildTags, Tags>(std::forward<Ctx>(ctx))...);
+  // Custom builders receive borrowed references, and take ownership of
+  // whatever they reuse themselves.
+  template <typename Ctx>
+  static auto build(const custom_builder_expr<F, Tags...>& expr, Ctx&& ctx,
+                    node_pool*) {
+    return expr.func(get_result<Tags>(ctx)...);
   }
 };
 
 template <>
 struct builder_traits<literal_expr> {
-  template <typename BuildTags, typename Ctx>
-  static auto build(const literal_expr& expr, Ctx&&) {
+  template <typename Ctx>
+  static auto build(const literal_expr& expr, Ctx&&, node_pool* pool) {
+    if (auto node = pool ? pool->take<mparse::literal_node>() : nullptr) {
+      node->set_val(expr.val);
+      return node;
+    }
     return mparse::make_ast_node<mparse::literal_node>(expr.val);
   }
 };
 
 template <>
 struct builder_traits<id_expr> {
-  template <typename BuildTags, typename Ctx>
-  static auto build(const id_expr& expr, Ctx&&) {
+  template <typename Ctx>
+  static auto build(const id_expr& expr, Ctx&&, node_pool*) {
     return mparse::make_ast_node<mparse::id_node>(std::string(expr.name));
   }
 };
 
 template <typename... Args>
 struct builder_traits<func_expr<Args...>> {
-  using tags = util::type_list_cat_t<impl::get_build_tags_t<Args>...>;
 
-  template <typename BuildTags, typename Ctx>
-  static auto build(const func_expr<Args...>& expr, Ctx&& ctx) {
+  template <typename Ctx>
+  static auto build(const func_expr<Args...>& expr, Ctx&& ctx,
+                    node_pool* pool) {
     auto args = std::apply(
         [&](auto&&... arg_exprs) {
           return mparse::func_node::arg_list{
-              builder_traits<Args>::template build<BuildTags>(
-                  arg_exprs, std::forward<Ctx>(ctx))...};
+              builder_traits<Args>::build(
+                  arg_exprs, std::forward<Ctx>(ctx), pool)...};
         },
         expr.args);
 
@@ -95,24 +185,35 @@ struct builder_traits<func_expr<Args...>> {
 
 template <typename Node, typename Inner>
 struct builder_traits<unary_expr<Node, Inner>> {
-  using tags = impl::get_build_tags_t<Inner>;
 
-  template <typename BuildTags, typename Ctx>
-  static auto build(const unary_expr<Node, Inner>& expr, Ctx&& ctx) {
-    auto inner_node = builder_traits<Inner>::template build<BuildTags>(
-        expr.inner, std::forward<Ctx>(ctx));
+  template <typename Ctx>
+  static auto build(const unary_expr<Node, Inner>& expr, Ctx&& ctx,
+                    node_pool* pool) {
+    auto inner_node = builder_traits<Inner>::build(
+        expr.inner, std::forward<Ctx>(ctx), pool);
+
+    if (auto node = pool ? pool->take<Node>() : nullptr) {
+      node->set_child(std::move(inner_node));
+      return node;
+    }
     return mparse::make_ast_node<Node>(std::move(inner_node));
   }
 };
 
 template <mparse::unary_op_type Type, typename Inner>
 struct builder_traits<unary_op_expr<Type, Inner>> {
-  using tags = impl::get_build_tags_t<Inner>;
 
-  template <typename BuildTags, typename Ctx>
-  static auto build(const unary_op_expr<Type, Inner>& expr, Ctx&& ctx) {
-    auto inner_node = builder_traits<Inner>::template build<BuildTags>(
-        expr.inner, std::forward<Ctx>(ctx));
+  template <typename Ctx>
+  static auto build(const unary_op_expr<Type, Inner>& expr, Ctx&& ctx,
+                    node_pool* pool) {
+    auto inner_node = builder_traits<Inner>::build(
+        expr.inner, std::forward<Ctx>(ctx), pool);
+
+    if (auto node = pool ? pool->take<mparse::unary_op_node>() : nullptr) {
+      node->set_type(Type);
+      node->set_child(std::move(inner_node));
+      return node;
+    }
     return mparse::make_ast_node<mparse::unary_op_node>(Type,
                                                         std::move(inner_node));
   }
@@ -120,17 +221,21 @@ struct builder_traits<unary_op_expr<Type, Inner>> {
 
 template <mparse::binary_op_type Type, typename Lhs, typename Rhs, bool Commute>
 struct builder_traits<binary_op_expr<Type, Lhs, Rhs, Commute>> {
-  using tags = util::type_list_cat_t<impl::get_build_tags_t<Lhs>,
-                                     impl::get_build_tags_t<Rhs>>;
 
-  template <typename BuildTags, typename Ctx>
+  template <typename Ctx>
   static auto build(const binary_op_expr<Type, Lhs, Rhs, Commute>& expr,
-                    Ctx&& ctx) {
-    auto lhs_node = builder_traits<Lhs>::template build<BuildTags>(
-        expr.lhs, std::forward<Ctx>(ctx));
-    auto rhs_node = builder_traits<Rhs>::template build<BuildTags>(
-        expr.rhs, std::forward<Ctx>(ctx));
-
+                    Ctx&& ctx, node_pool* pool) {
+    auto lhs_node = builder_traits<Lhs>::build(
+        expr.lhs, std::forward<Ctx>(ctx), pool);
+    auto rhs_node = builder_traits<Rhs>::build(
+        expr.rhs, std::forward<Ctx>(ctx), pool);
+
+    if (auto node = pool ? pool->take<mparse::binary_op_node>() : nullptr) {
+      node->set_type(Type);
+      node->set_lhs(std::move(lhs_node));
+      node->set_rhs(std::move(rhs_node));
+      return node;
+    }
     return mparse::make_ast_node<mparse::binary_op_node>(
         Type, std::move(lhs_node), std::move(rhs_node));
   }
@@ -138,31 +243,29 @@ struct builder_traits<binary_op_expr<Type, Lhs, Rhs, Commute>> {
 
 template <typename Tag, typename Expr>
 struct builder_traits<capture_expr_impl<Tag, Expr>> {
-  using tags = util::type_list<Tag>;
 
-  template <typename BuildTags, typename Ctx>
-  static auto build(const capture_expr_impl<Tag, Expr>&, Ctx&& ctx) {
-    return impl::get_build_result<BuildTags, Tag>(std::forward<Ctx>(ctx));
+  template <typename Ctx>
+  static auto build(const capture_expr_impl<Tag, Expr>&, Ctx&& ctx,
+                    node_pool*) {
+    return impl::get_build_result<Tag>(std::forward<Ctx>(ctx));
   }
 };
 
 template <char C, typename Comp>
 struct builder_traits<subexpr_expr<C, Comp>> {
-  using tags = util::type_list<subexpr_expr_tag<C>>;
 
-  template <typename BuildTags, typename Ctx>
-  static auto build(const subexpr_expr<C, Comp>&, Ctx&& ctx) {
-    return impl::get_build_result<BuildTags, subexpr_expr_tag<C>>(
-        std::forward<Ctx>(ctx));
+  template <typename Ctx>
+  static auto build(const subexpr_expr<C, Comp>&, Ctx&& ctx, node_pool*) {
+    return impl::get_build_result<subexpr_expr_tag<C>>(std::forward<Ctx>(ctx));
   }
 };
 
 
+// Nodes taken from `pool`, if any, are reused in place of fresh allocations.
 template <typename Expr, typename Ctx>
-mparse::ast_node_ptr build_expr(Expr expr, Ctx&& ctx) {
-  using build_tags = impl::get_build_tags_t<Expr>;
-  return builder_traits<Expr>::template build<build_tags>(
-      expr, std::forward<Ctx>(ctx));
+mparse::ast_node_ptr build_expr(Expr expr, Ctx&& ctx,
+                                node_pool* pool = nullptr) {
+  return builder_traits<Expr>::build(expr, std::forward<Ctx>(ctx), pool);
 }
 
 } // namespace ast_ops::matching
\ No newline at end of file
@@ -0,0 +1,80 @@
+#include "compare.h"
+
+#include "mparse/traversal.h"
+#include <functional>
+#include <string>
+
+namespace ast_ops::matching {
+namespace {
+
+std::size_t combine_hashes(std::size_t seed, std::size_t val) {
+  return seed ^ (val + 0x9e3779b97f4a7c15 + (seed << 6) + (seed >> 2));
+}
+
+// Hashes what `default_expr_comparer` compares locally.
+struct local_hash_visitor : mparse::const_ast_visitor<local_hash_visitor> {
+  void operator()(const mparse::paren_node&) { result = 1; }
+  void operator()(const mparse::abs_node&) { result = 2; }
+
+  void operator()(const mparse::unary_op_node& node) {
+    result = combine_hashes(3, static_cast<std::size_t>(node.type()));
+  }
+
+  void operator()(const mparse::binary_op_node& node) {
+    result = combine_hashes(4, static_cast<std::size_t>(node.type()));
+  }
+
+  void operator()(const mparse::func_node& node) {
+    result = combine_hashes(5, std::hash<std::string>{}(node.name()));
+    result = combine_hashes(result, node.args().size());
+  }
+
+  void operator()(const mparse::id_node& node) {
+    result = combine_hashes(6, std::hash<std::string>{}(node.name()));
+  }
+
+  void operator()(const mparse::literal_node& node) {
+    // -0 and 0 compare equal
+    double val = node.val() == 0 ? 0 : node.val();
+    result = combine_hashes(7, std::hash<double>{}(val));
+  }
+
+  std::size_t result = 0;
+};
+
+struct subexpr_hasher : mparse::ast_traversal<subexpr_hasher> {
+  void leave(const mparse::ast_node& node) {
+    local_hash_visitor vis;
+    mparse::apply_visitor(vis, node);
+    std::size_t ret = vis.result;
+
+    auto* bin = mparse::ast_node_cast<const mparse::binary_op_node>(&node);
+    if (bin && is_commutative(bin->type())) {
+      // independent of the order of the operands
+      std::size_t lhs = hashes.at(bin->lhs());
+      std::size_t rhs = hashes.at(bin->rhs());
+      ret = combine_hashes(ret, lhs + rhs);
+      ret = combine_hashes(ret, lhs ^ rhs);
+    } else {
+      for (std::size_t i = 0; i < mparse::child_count(node); i++) {
+        ret = combine_hashes(ret, hashes.at(mparse::get_child(node, i)));
+      }
+    }
+
+    hashes[&node] = ret;
+  }
+
+  std::unordered_map<const mparse::ast_node*, std::size_t> hashes;
+};
+
+} // namespace
+
+
+std::unordered_map<const mparse::ast_node*, std::size_t> hash_subexprs(
+    const mparse::ast_node& root) {
+  subexpr_hasher hasher;
+  mparse::traverse(hasher, root);
+  return std::move(hasher.hashes);
+}
+
+} // namespace ast_ops::matching
\ No newline at end of file
@@ -2,7 +2,10 @@
 
 #include "ast_ops/matching/util.h"
 #include "mparse/ast.h"
+#include <cstddef>
 #include <type_traits>
+#include <unordered_map>
+#include <vector>
 
 namespace ast_ops::matching {
 namespace impl {
@@ -101,61 +104,34 @@ void compare_visitor<Comp>::operator()(const mparse::literal_node& node) {
 } // namespace impl
 
 
+// Comparers only decide whether two nodes of the same type are equivalent
+// locally (operator types, names, values...); their children are compared by
+// `compare_exprs` itself.
 template <typename Der>
 struct default_expr_comparer_base {
-  bool compare_paren(const mparse::paren_node& first,
-                     const mparse::paren_node& second) const {
-    return compare_exprs(*first.child(), *second.child(),
-                         static_cast<const Der&>(*this));
+  bool compare_paren(const mparse::paren_node&,
+                     const mparse::paren_node&) const {
+    return true;
   }
 
-  bool compare_abs(const mparse::abs_node& first,
-                   const mparse::abs_node& second) const {
-    return compare_exprs(*first.child(), *second.child(),
-                         static_cast<const Der&>(*this));
+  bool compare_abs(const mparse::abs_node&, const mparse::abs_node&) const {
+    return true;
   }
 
   bool compare_unary(const mparse::unary_op_node& first,
                      const mparse::unary_op_node& second) const {
-    return first.type() == second.type() &&
-           compare_exprs(*first.child(), *second.child(),
-                         static_cast<const Der&>(*this));
+    return first.type() == second.type();
   }
 
   bool compare_binary(const mparse::binary_op_node& first,
                       const mparse::binary_op_node& second) const {
-    if (first.type() != second.type()) {
-      return false;
-    }
-
-    if (compare_exprs(*first.lhs(), *second.lhs(),
-                      static_cast<const Der&>(*this)) &&
-        compare_exprs(*first.rhs(), *second.rhs(),
-                      static_cast<const Der&>(*this))) {
-      return true;
-    } else if (is_commutative(first.type()) &&
-               compare_exprs(*first.lhs(), *second.rhs(),
-                             static_cast<const Der&>(*this)) &&
-               compare_exprs(*first.rhs(), *second.lhs(),
-                             static_cast<const Der&>(*this))) {
-      return true;
-    }
-
-    return false;
+    return first.type() == second.type();
   }
 
   bool compare_func(const mparse::func_node& first,
                     const mparse::func_node& second) const {
-    const auto& first_args = first.args();
-    const auto& second_args = second.args();
-
     return first.name() == second.name() &&
-           std::equal(first_args.begin(), first_args.end(), second_args.begin(),
-                      second_args.end(),
-                      [&](const auto& arg1, const auto& arg2) {
-                        return compare_exprs(*arg1, *arg2,
-                                             static_cast<const Der&>(*this));
-                      });
+           first.args().size() == second.args().size();
   }
 
   bool compare_id(const mparse::id_node& first,
@@ -173,18 +149,124 @@ struct default_expr_comparer
     : default_expr_comparer_base<default_expr_comparer> {};
 
 
+namespace impl {
+
 template <typename Comp>
-bool compare_exprs(const mparse::ast_node& first,
-                   const mparse::ast_node& second, Comp&& comp) {
-  impl::compare_visitor<std::remove_reference_t<Comp>> vis(&second, comp);
+bool compare_nodes(const mparse::ast_node& first,
+                   const mparse::ast_node& second, Comp& comp) {
+  impl::compare_visitor<Comp> vis(&second, comp);
   mparse::apply_visitor(vis, first);
   return vis.result;
 }
 
+
+// Pending comparisons are kept in immutable linked lists sharing their tails,
+// so that backtracking to an alternative only requires restoring a list head.
+struct compare_goal {
+  enum class goal_type { compare, cut };
+
+  goal_type type;
+  const mparse::ast_node* first;
+  const mparse::ast_node* second;
+  std::size_t cut_depth;
+  std::ptrdiff_t next;
+};
+
+struct compare_state {
+  void push_compare(const mparse::ast_node* first,
+                    const mparse::ast_node* second) {
+    goals.push_back(
+        {compare_goal::goal_type::compare, first, second, 0, head});
+    head = goals.size() - 1;
+  }
+
+  void push_cut(std::size_t cut_depth) {
+    goals.push_back(
+        {compare_goal::goal_type::cut, nullptr, nullptr, cut_depth, head});
+    head = goals.size() - 1;
+  }
+
+  std::vector<compare_goal> goals;
+  std::ptrdiff_t head = -1;
+
+  // heads of alternative goal lists to try on failure
+  std::vector<std::ptrdiff_t> choices;
+};
+
+} // namespace impl
+
+
+// Compares `first` and `second` structurally, also trying swapped operands of
+// commutative operators. An explicit goal list is used instead of recursion
+// so that arbitrarily deep trees can be compared.
+template <typename Comp>
+bool compare_exprs(const mparse::ast_node& first,
+                   const mparse::ast_node& second, Comp&& comp) {
+  impl::compare_state state;
+  state.push_compare(&first, &second);
+
+  while (state.head >= 0) {
+    impl::compare_goal goal = state.goals[state.head];
+    state.head = goal.next;
+
+    if (goal.type == impl::compare_goal::goal_type::cut) {
+      // the guarded comparison succeeded - drop the alternatives it left
+      state.choices.resize(goal.cut_depth);
+      continue;
+    }
+
+    bool matched = impl::compare_nodes(*goal.first, *goal.second, comp);
+
+    if (matched) {
+      auto* first_bin =
+          mparse::ast_node_cast<const mparse::binary_op_node>(goal.first);
+
+      if (first_bin && is_commutative(first_bin->type())) {
+        auto* second_bin =
+            static_cast<const mparse::binary_op_node*>(goal.second);
+        std::size_t cut_depth = state.choices.size();
+        std::ptrdiff_t rest = state.head;
+
+        // alternative: swapped operands
+        state.push_cut(cut_depth);
+        state.push_compare(first_bin->rhs(), second_bin->lhs());
+        state.push_compare(first_bin->lhs(), second_bin->rhs());
+        state.choices.push_back(state.head);
+
+        state.head = rest;
+        state.push_cut(cut_depth);
+        state.push_compare(first_bin->rhs(), second_bin->rhs());
+        state.push_compare(first_bin->lhs(), second_bin->lhs());
+      } else {
+        for (auto i = mparse::child_count(*goal.first); i-- > 0;) {
+          state.push_compare(mparse::get_child(*goal.first, i),
+                             mparse::get_child(*goal.second, i));
+        }
+      }
+    } else {
+      if (state.choices.empty()) {
+        return false;
+      }
+
+      state.head = state.choices.back();
+      state.choices.pop_back();
+    }
+  }
+
+  return true;
+}
+
 template <typename Comp = default_expr_comparer>
 bool compare_exprs(const mparse::ast_node& first,
                    const mparse::ast_node& second) {
   return compare_exprs(first, second, Comp{});
 }
 
+
+// Hashes of every subtree of `root`, consistent with `compare_exprs` using the
+// default comparer: equivalent subtrees, including those differing only in the
+// order of commutative operands, hash equally.
+std::unordered_map<const mparse::ast_node*, std::size_t> hash_subexprs(
+    const mparse::ast_node& root);
+
 } // namespace ast_ops::matching
\ No newline at end of file
@@ -65,7 +65,7 @@ struct matcher_traits<func_expr<Args...>> {
 private:
   template <typename... Args, size_t... I, typename Ctx>
   static bool match_helper(const std::tuple<Args...>& args,
-                           match_type::arg_list& arg_nodes,
+                           const match_type::arg_list& arg_nodes,
                            std::index_sequence<I...>, Ctx& ctx) {
     return (matcher_traits<Args>::match(std::get<I>(args), arg_nodes[I], ctx) &&
             ...);
@@ -80,7 +80,7 @@ public:
         return false;
       }
 
-      auto& arg_nodes = fn_node->args();
+      const auto& arg_nodes = fn_node->args();
       if (arg_nodes.size() != sizeof...(Args)) {
         return false;
       }
@@ -105,11 +105,12 @@ struct matcher_traits<binary_op_pred_expr<Pred, Lhs, Rhs, Commute>> {
         return false;
       }
 
-      auto node_lhs = bin_node->ref_lhs();
-      auto node_rhs = bin_node->ref_rhs();
+      const auto& node_lhs = bin_node->lhs_ptr();
+      const auto& node_rhs = bin_node->rhs_ptr();
 
-      // Save original context so that it can be restored if necessary.
-      auto old_ctx = ctx;
+      // Remember where we were so that the context can be restored if
+      // necessary.
+      auto checkpoint = ctx.checkpoint();
 
       if (matcher_traits<Lhs>::match(expr.lhs, node_lhs, ctx) &&
           matcher_traits<Rhs>::match(expr.rhs, node_rhs, ctx)) {
@@ -117,7 +118,7 @@ struct matcher_traits<binary_op_pred_expr<Pred, Lhs, Rhs, Commute>> {
       }
 
       if constexpr (Commute) {
-        ctx = std::move(old_ctx);
+        ctx.rollback(checkpoint);
 
         if (matcher_traits<Lhs>::match(expr.lhs, node_rhs, ctx) &&
             matcher_traits<Rhs>::match(expr.rhs, node_lhs, ctx)) {
@@ -138,7 +139,7 @@ struct matcher_traits<unary_expr<Node, Inner>> {
   static bool match(const unary_expr<Node, Inner>& expr,
                     const mparse::ast_node_ptr& node, Ctx& ctx) {
     if (auto* un_node = mparse::ast_node_cast<match_type>(node.get())) {
-      return matcher_traits<Inner>::match(expr.inner, un_node->ref_child(),
+      return matcher_traits<Inner>::match(expr.inner, un_node->child_ptr(),
                                           ctx);
     }
     return false;
@@ -158,7 +159,7 @@ struct matcher_traits<unary_op_pred_expr<Pred, Inner>> {
         return false;
       }
 
-      return matcher_traits<Inner>::match(expr.inner, un_node->ref_child(),
+      return matcher_traits<Inner>::match(expr.inner, un_node->child_ptr(),
                                           ctx);
     }
     return false;
@@ -233,7 +234,7 @@ using get_match_type_t = typename get_match_type<E>::type;
 template <typename Tag, typename Expr>
 struct matcher_traits<capture_expr_impl<Tag, Expr>> {
   using inner_match_type = impl::get_match_type_t<Expr>;
-  using captures = caplist<capture<Tag, mparse::node_ptr<inner_match_type>>>;
+  using captures = caplist<capture<Tag, node_ref<inner_match_type>>>;
 
   static_assert(std::is_same_v<get_captures_t<Expr>, caplist<>>,
                 "Nested captures are not supported");
@@ -242,8 +243,7 @@ struct matcher_traits<capture_expr_impl<Tag, Expr>> {
   static bool match(const capture_expr_impl<Tag, Expr>& expr,
                     const mparse::ast_node_ptr& node, Ctx& ctx) {
     if (matcher_traits<Expr>::match(expr.expr, node, ctx)) {
-      get_result<Tag>(ctx) =
-          mparse::static_ast_node_ptr_cast<inner_match_type>(node);
+      set_result<Tag>(ctx, node_ref<inner_match_type>(node));
       return true;
     }
     return false;
@@ -252,28 +252,25 @@ struct matcher_traits<capture_expr_impl<Tag, Expr>> {
 
 template <char C, typename Comp>
 struct matcher_traits<subexpr_expr<C, Comp>> {
-  using captures = caplist<capture<subexpr_expr_tag<C>, mparse::ast_node_ptr>>;
+  using captures =
+      caplist<capture<subexpr_expr_tag<C>, node_ref<mparse::ast_node>>>;
 
   template <typename Ctx>
   static bool match(const subexpr_expr<C, Comp>& expr,
                     const mparse::ast_node_ptr& node, Ctx& ctx) {
-    auto& saved = get_subexpr<C>(ctx);
+    using tag_type = subexpr_expr_tag<C>;
 
-    if constexpr (Ctx::template count_caps_with<subexpr_expr_tag<C>>() > 1) {
+    if constexpr (Ctx::template count_caps_with<tag_type>() > 1) {
       // subexpression appears multiple times - compare with stored result
 
-      if (!saved) {
-        saved = node;
-        return true;
+      if (const auto& saved = get_subexpr<C>(ctx)) {
+        return compare_exprs(*saved, *node, expr.comp);
       }
-
-      return compare_exprs(*saved, *node, expr.comp);
-    } else {
-      // expression appears only once - don't even try to compare
-
-      saved = node;
-      return true;
     }
+
+    // first (or only) appearance - don't even try to compare
+    set_result<tag_type>(ctx, node_ref<mparse::ast_node>(node));
+    return true;
   }
 };
 
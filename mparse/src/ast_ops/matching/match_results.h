@@ -3,6 +3,9 @@
 #include "ast_ops/matching/expr.h"
 #include "mparse/ast.h"
 #include "util/meta.h"
+#include <array>
+#include <cassert>
+#include <cstddef>
 #include <type_traits>
 #include <utility>
 
@@ -70,6 +73,8 @@ public:
     static_assert(util::always_false<T>, "Expression not captured");
     return 0;
   }
+
+  void pin() {}
 };
 
 template <typename Cap, typename... Caps>
@@ -88,6 +93,13 @@ public:
 
   const cap_type&& get(tag_type) const&& { return std::move(cap_); }
 
+  void pin() {
+    if constexpr (requires { cap_.pin(); }) {
+      cap_.pin();
+    }
+    match_results_base<Caps...>::pin();
+  }
+
 private:
   cap_type cap_;
 };
@@ -107,6 +119,50 @@ using get_match_results_base_t =
 } // namespace impl
 
 
+// Borrowed reference to a matched node. Only the address of the pointer owning
+// the node is stored, so that recording a capture touches no reference counts
+// while ownership can still be taken once the capture is actually used. Valid
+// only as long as the matched tree is left unmodified, unless pinned.
+class node_ref_base {
+public:
+  node_ref_base() = default;
+  explicit node_ref_base(const mparse::ast_node_ptr& owner) : owner_(&owner) {}
+
+  explicit operator bool() const { return owner_ || pinned_; }
+
+  const mparse::ast_node_ptr& owner() const {
+    return owner_ ? *owner_ : pinned_;
+  }
+
+  // Takes a reference to the node, keeping it valid even once the matched tree
+  // is modified.
+  void pin() {
+    if (owner_) {
+      pinned_ = *owner_;
+      owner_ = nullptr;
+    }
+  }
+
+private:
+  const mparse::ast_node_ptr* owner_ = nullptr;
+  mparse::ast_node_ptr pinned_;
+};
+
+template <typename Node>
+class node_ref : public node_ref_base {
+public:
+  using node_ref_base::node_ref_base;
+
+  const Node* get() const { return static_cast<const Node*>(owner().get()); }
+  const Node& operator*() const { return *get(); }
+  const Node* operator->() const { return get(); }
+
+  mparse::node_ptr<Node> to_owned() const {
+    return mparse::static_ast_node_ptr_cast<Node>(owner());
+  }
+};
+
+
 template <typename Tag, typename Cap>
 struct capture {
   using tag_type = Tag;
@@ -149,6 +205,26 @@ public:
     return impl::count_caps_v<Tag, Caps>;
   }
 
+  match_results() = default;
+
+  // The undo log refers to this object, so it is not carried over.
+  match_results(const match_results& rhs) : base_type(rhs) {}
+  match_results& operator=(const match_results& rhs) {
+    base_type::operator=(rhs);
+    trail_size_ = 0;
+    return *this;
+  }
+
+  // Pins all captured node references, so that the results outlive changes to
+  // the matched tree.
+  void pin_captures() { this->pin(); }
+
+  // Backtracking support: assignments made through `set_result` since a
+  // checkpoint are recorded, and undone by rolling back to it. This costs
+  // only as much as the number of captures that actually changed.
+  std::size_t checkpoint() const { return trail_size_; }
+  void rollback(std::size_t checkpoint);
+
   template <typename Tag, typename E>
   friend decltype(auto) get_result(match_results<E>& match);
 
@@ -160,8 +236,32 @@ public:
 
   template <typename Tag, typename E>
   friend decltype(auto) get_result(const match_results<E>&& match);
+
+  template <typename Tag, typename E, typename T>
+  friend void set_result(match_results<E>& match, T&& val);
+
+private:
+  using base_type = impl::get_match_results_base_t<Caps>;
+
+  struct trail_entry {
+    node_ref_base* cap;
+    node_ref_base old_val;
+  };
+
+  // Every capture is assigned at most once between checkpoints, so the log
+  // can never outgrow the number of captures in the expression.
+  std::array<trail_entry, Caps::size> trail_;
+  std::size_t trail_size_ = 0;
 };
 
+template <typename Caps>
+void match_results<Caps>::rollback(std::size_t checkpoint) {
+  while (trail_size_ > checkpoint) {
+    trail_entry& entry = trail_[--trail_size_];
+    *entry.cap = std::move(entry.old_val);
+  }
+}
+
 template <typename E>
 using match_results_for = match_results<get_captures_t<E>>;
 
@@ -187,6 +287,18 @@ decltype(auto) get_result(const match_results<E>&& match) {
 }
 
 
+// Assigns a node reference capture, recording the assignment so that it can be
+// rolled back.
+template <typename Tag, typename E, typename T>
+void set_result(match_results<E>& match, T&& val) {
+  node_ref_base& cap = match.get(Tag{});
+
+  assert(match.trail_size_ < match.trail_.size());
+  match.trail_[match.trail_size_++] = {&cap, std::move(cap)};
+  cap = std::forward<T>(val);
+}
+
+
 template <int N, typename Res>
 decltype(auto) get_capture(Res&& results) {
   return get_result<capture_expr_tag<N>>(std::forward<Res>(results));
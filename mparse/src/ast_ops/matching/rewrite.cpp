@@ -1,53 +1,84 @@
 #include "rewrite.h"
 
+#include "ast_ops/clone.h"
 #include "mparse/ast.h"
+#include <algorithm>
+#include <ostream>
+#include <utility>
+#include <vector>
 
 namespace ast_ops::matching {
-namespace {
 
-struct child_apply_visitor : mparse::ast_visitor<child_apply_visitor> {
-  explicit child_apply_visitor(const basic_rewriter_func& func) : func(func) {}
+rewrite_stats::pass_stats& rewrite_stats::get_pass(std::string_view name) {
+  auto it = std::find_if(passes_.begin(), passes_.end(),
+                         [&](const auto& pass) { return pass.name == name; });
+  if (it != passes_.end()) {
+    return *it;
+  }
 
-  void operator()(mparse::unary_node& node);
-  void operator()(mparse::binary_op_node& node);
-  void operator()(mparse::func_node& node);
+  return passes_.emplace_back(pass_stats{std::string(name), {}});
+}
 
-  const basic_rewriter_func& func;
-};
+void rewrite_stats::write_json(std::ostream& stream) const {
+  stream << "{\n  \"iterations\": " << iterations << ",\n  \"passes\": [";
 
-void child_apply_visitor::operator()(mparse::unary_node& node) {
-  auto child = node.ref_child(); // ref here for strong exception guarantee
-  func(child);
-  node.set_child(std::move(child));
-}
+  bool first_pass = true;
+  for (const auto& pass : passes_) {
+    stream << (std::exchange(first_pass, false) ? "\n" : ",\n");
+    stream << "    {\n      \"name\": \"" << pass.name
+           << "\",\n      \"rules\": [";
 
-void child_apply_visitor::operator()(mparse::binary_op_node& node) {
-  {
-    auto lhs = node.ref_lhs(); // ref here for strong exception guarantee
-    func(lhs);
-    node.set_lhs(std::move(lhs));
-  }
+    for (std::size_t i = 0; i < pass.rules.size(); i++) {
+      const rule_stats& rule = pass.rules[i];
 
-  {
-    auto rhs = node.ref_rhs(); // ref here for strong exception guarantee
-    func(rhs);
-    node.set_rhs(std::move(rhs));
+      stream << (i == 0 ? "\n" : ",\n");
+      stream << "        {\"index\": " << i
+             << ", \"attempts\": " << rule.attempts
+             << ", \"successes\": " << rule.successes
+             << ", \"nodes_allocated\": " << rule.nodes_allocated
+             << ", \"time_ns\": " << rule.time.count() << "}";
+    }
+
+    stream << "\n      ]\n    }";
   }
+
+  stream << "\n  ]\n}\n";
 }
 
-void child_apply_visitor::operator()(mparse::func_node& node) {
-  for (auto& arg : node.args()) {
-    func(arg);
+
+void unshare(mparse::ast_node_ptr& node) {
+  if (node.use_count() > 1) {
+    node = clone_node(*node);
   }
 }
 
-} // namespace
 
+namespace impl {
 
-void apply_to_children(mparse::ast_node& node,
-                       const basic_rewriter_func& func) {
-  child_apply_visitor vis(func);
-  mparse::apply_visitor(vis, node);
+std::size_t count_unshared_nodes(const mparse::ast_node_ptr& node) {
+  std::size_t count = 0;
+  std::vector<mparse::ast_node*> pending;
+
+  if (node.use_count() == 1) {
+    pending.push_back(node.get());
+  }
+
+  while (!pending.empty()) {
+    mparse::ast_node* cur_node = pending.back();
+    pending.pop_back();
+    count++;
+
+    for (std::size_t i = 0; i < mparse::child_count(*cur_node); i++) {
+      const auto& child = mparse::get_child_slot(*cur_node, i);
+      if (child && child.use_count() == 1) {
+        pending.push_back(child.get());
+      }
+    }
+  }
+
+  return count;
 }
 
+} // namespace impl
+
 } // namespace ast_ops::matching
\ No newline at end of file
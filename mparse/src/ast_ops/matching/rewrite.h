@@ -4,16 +4,216 @@
 #include "ast_ops/matching/match.h"
 #include "ast_ops/matching/match_results.h"
 #include "mparse/ast.h"
-#include <functional>
+#include "util/auto_restore.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <iosfwd>
+#include <string>
+#include <string_view>
 #include <tuple>
 #include <type_traits>
+#include <vector>
 
 namespace ast_ops::matching {
 
+/* STATISTICS */
+
+struct rule_stats {
+  std::uint64_t attempts = 0;
+  std::uint64_t successes = 0;
+  std::uint64_t nodes_allocated = 0;
+  std::chrono::nanoseconds time{0};
+};
+
+// Statistics gathered by the rewriting functions while a `stats_scope` is
+// active on the current thread. Rules are only recorded inside a `stats_pass`,
+// which names them, and are identified by their index in the rewriter list.
+class rewrite_stats {
+public:
+  struct pass_stats {
+    std::string name;
+    std::vector<rule_stats> rules;
+  };
+
+  const std::deque<pass_stats>& passes() const { return passes_; }
+  pass_stats& get_pass(std::string_view name);
+
+  void write_json(std::ostream& stream) const;
+
+  // fixed-point iterations run by `simplify`
+  std::uint64_t iterations = 0;
+
+private:
+  std::deque<pass_stats> passes_; // stable references
+};
+
+
+/* MONITORING */
+
+// Observer of the rewriting functions, installed on the current thread with a
+// `monitor_scope`. `on_rule` is invoked after every rule attempt and may throw
+// to abandon the current traversal, leaving a valid tree behind.
+class rewrite_monitor {
+public:
+  virtual void on_rule(bool rewritten) = 0;
+
+protected:
+  ~rewrite_monitor() = default;
+};
+
+
+namespace impl {
+
+struct rewrite_state {
+  rewrite_stats* stats = nullptr;
+  rewrite_stats::pass_stats* pass = nullptr;
+  std::uint64_t nodes_allocated = 0;
+
+  rewrite_monitor* monitor = nullptr;
+};
+
+inline thread_local rewrite_state cur_state;
+
+inline bool collecting_stats() {
+  return cur_state.pass;
+}
+
+inline bool is_instrumented() {
+  return cur_state.pass || cur_state.monitor;
+}
+
+// Counts the nodes of the freshly built tree `node`, i.e. those not shared with
+// the matched tree or the captures.
+std::size_t count_unshared_nodes(const mparse::ast_node_ptr& node);
+
+} // namespace impl
+
+inline rewrite_stats* active_stats() {
+  return impl::cur_state.stats;
+}
+
+class stats_scope {
+public:
+  explicit stats_scope(rewrite_stats& stats)
+      : save_stats_(impl::cur_state.stats, &stats),
+        save_pass_(impl::cur_state.pass, nullptr) {}
+
+private:
+  util::auto_restore<rewrite_stats*> save_stats_;
+  util::auto_restore<rewrite_stats::pass_stats*> save_pass_;
+};
+
+class stats_pass {
+public:
+  explicit stats_pass(std::string_view name)
+      : save_pass_(impl::cur_state.pass, get_pass(name)) {}
+
+private:
+  static rewrite_stats::pass_stats* get_pass(std::string_view name) {
+    auto* stats = active_stats();
+    return stats ? &stats->get_pass(name) : nullptr;
+  }
+
+  util::auto_restore<rewrite_stats::pass_stats*> save_pass_;
+};
+
+class monitor_scope {
+public:
+  explicit monitor_scope(rewrite_monitor& monitor)
+      : save_monitor_(impl::cur_state.monitor, &monitor) {}
+
+private:
+  util::auto_restore<rewrite_monitor*> save_monitor_;
+};
+
+
+namespace impl {
+
+template <typename F>
+bool record_stats(std::size_t idx, F&& func) {
+  auto* pass = cur_state.pass;
+  if (!pass) {
+    return std::forward<F>(func)();
+  }
+
+  if (idx >= pass->rules.size()) {
+    pass->rules.resize(idx + 1);
+  }
+
+  std::uint64_t old_allocated = cur_state.nodes_allocated;
+  auto start = std::chrono::steady_clock::now();
+
+  bool ret = std::forward<F>(func)();
+
+  rule_stats& rule = pass->rules[idx];
+  rule.time += std::chrono::steady_clock::now() - start;
+  rule.attempts++;
+  rule.successes += ret;
+  rule.nodes_allocated += cur_state.nodes_allocated - old_allocated;
+  return ret;
+}
+
+} // namespace impl
+
+// Runs the rule `func`, crediting the attempt to rule `idx` of the current
+// pass when collecting statistics and reporting it to the current monitor.
+template <typename F>
+bool record_rule(std::size_t idx, F&& func) {
+  bool ret = impl::record_stats(idx, std::forward<F>(func));
+
+  if (auto* monitor = impl::cur_state.monitor) {
+    monitor->on_rule(ret);
+  }
+  return ret;
+}
+
+// Credits the nodes of the freshly built tree `node` to the current rule when
+// collecting statistics; for rules that build nodes outside of `rewrite`.
+inline void record_built(const mparse::ast_node_ptr& node) {
+  if (impl::collecting_stats()) {
+    impl::cur_state.nodes_allocated += impl::count_unshared_nodes(node);
+  }
+}
+
+
+/* REWRITING */
+
 template <typename M, typename B>
 bool rewrite(mparse::ast_node_ptr& node, const M& matcher, const B& builder) {
   if (auto res = exec_match(matcher, node)) {
-    node = build_expr(builder, std::move(*res));
+    mparse::ast_node_ptr built;
+
+    if constexpr (impl::is_nothrow_builder<B>) {
+      // The matched tree is about to be replaced, so whatever part of it isn't
+      // shared or captured can be relinked into the new one.
+      res->pin_captures();
+
+      node_pool pool;
+      pool.recycle(std::move(node));
+      std::size_t pooled = pool.size();
+
+      try {
+        built = build_expr(builder, std::move(*res), &pool);
+      } catch (...) {
+        // only allocation can fail; leave the tree as it was
+        node = pool.restore();
+        throw;
+      }
+      pool.commit();
+
+      if (impl::collecting_stats()) {
+        impl::cur_state.nodes_allocated +=
+            impl::count_unshared_nodes(built) - (pooled - pool.size());
+      }
+    } else {
+      // leave the tree intact in case building fails
+      built = build_expr(builder, std::move(*res));
+      record_built(built);
+    }
+
+    node = std::move(built);
     return true;
   }
   return false;
@@ -63,21 +263,35 @@ constexpr auto get_rewriters_after_expr(const M& matcher, const B& builder,
 } // namespace impl
 
 
+template <typename... Ts>
+class rewriter_list;
+
+namespace impl {
+
+template <bool Record, typename... Ts>
+bool apply_rewriters(mparse::ast_node_ptr& node,
+                     const rewriter_list<Ts...>& list);
+
+} // namespace impl
+
+
 template <typename... Ts>
 class rewriter_list {
 public:
   constexpr rewriter_list(const Ts&... args)
       : rewriters_(impl::get_rewriters(args...)) {}
 
-  template <typename... Us>
-  friend bool apply_rewriters(mparse::ast_node_ptr& node,
-                              const rewriter_list<Us...>& list);
+  template <bool Record, typename... Us>
+  friend bool impl::apply_rewriters(mparse::ast_node_ptr& node,
+                                    const rewriter_list<Us...>& list);
 
 private:
   decltype(impl::get_rewriters(std::declval<const Ts&>()...)) rewriters_;
 };
 
-template <typename... Ts>
+namespace impl {
+
+template <bool Record, typename... Ts>
 bool apply_rewriters(mparse::ast_node_ptr& node,
                      const rewriter_list<Ts...>& list) {
   return std::apply(
@@ -85,31 +299,97 @@ bool apply_rewriters(mparse::ast_node_ptr& node,
         bool ret = false;
 
         // no short-circuiting, executed in order
-        ((ret |= rewriters(node)), ...);
+        if constexpr (Record) {
+          std::size_t idx = 0;
+          ((ret |= record_rule(idx++, [&] { return rewriters(node); })), ...);
+        } else {
+          ((ret |= rewriters(node)), ...);
+        }
         return ret;
       },
       list.rewriters_);
 }
 
+// Invokes `func` with a function applying the rewriters in `list`, chosen once
+// so that a whole traversal pays nothing for statistics or monitoring unless
+// they are in use.
+template <typename F, typename... Ts>
+void with_rewriters(const rewriter_list<Ts...>& list, F&& func) {
+  if (is_instrumented()) {
+    func([&](mparse::ast_node_ptr& node) {
+      return apply_rewriters<true>(node, list);
+    });
+  } else {
+    func([&](mparse::ast_node_ptr& node) {
+      return apply_rewriters<false>(node, list);
+    });
+  }
+}
+
+} // namespace impl
+
+template <typename... Ts>
+bool apply_rewriters(mparse::ast_node_ptr& node,
+                     const rewriter_list<Ts...>& list) {
+  return impl::is_instrumented() ? impl::apply_rewriters<true>(node, list)
+                                 : impl::apply_rewriters<false>(node, list);
+}
+
 
-using basic_rewriter_func = std::function<void(mparse::ast_node_ptr&)>;
+// Subtrees referenced from several places are treated as immutable: replaces
+// `node` by a shallow copy if it is shared, so that its children may then be
+// modified without affecting other users.
+void unshare(mparse::ast_node_ptr& node);
 
-void apply_to_children(mparse::ast_node& node, const basic_rewriter_func& func);
+// The traversals below keep pointers to the slots holding the nodes still to
+// be visited, so that `func` may replace the node it is passed. Shared nodes
+// are unshared before their children are visited.
 
 template <typename F>
 void apply_top_down(mparse::ast_node_ptr& node, F&& func) {
-  std::forward<F>(func)(node);
-  apply_to_children(*node, [&](mparse::ast_node_ptr& cur_node) {
-    apply_top_down(cur_node, std::forward<F>(func));
-  });
+  std::vector<mparse::ast_node_ptr*> pending = {&node};
+
+  while (!pending.empty()) {
+    mparse::ast_node_ptr& cur_node = *pending.back();
+    pending.pop_back();
+
+    func(cur_node);
+
+    auto count = mparse::child_count(*cur_node);
+    if (count > 0) {
+      unshare(cur_node);
+    }
+
+    // push in reverse so that children are visited in order
+    for (auto i = count; i-- > 0;) {
+      pending.push_back(&mparse::get_child_slot(*cur_node, i));
+    }
+  }
 }
 
 template <typename F>
 void apply_bottom_up(mparse::ast_node_ptr& node, F&& func) {
-  apply_to_children(*node, [&](mparse::ast_node_ptr& cur_node) {
-    apply_bottom_up(cur_node, std::forward<F>(func));
-  });
-  std::forward<F>(func)(node);
+  struct frame {
+    mparse::ast_node_ptr* slot;
+    std::size_t next_child;
+  };
+
+  std::vector<frame> stack = {{&node, 0}};
+
+  while (!stack.empty()) {
+    mparse::ast_node_ptr& cur_node = *stack.back().slot;
+    std::size_t idx = stack.back().next_child++;
+
+    if (idx < mparse::child_count(*cur_node)) {
+      if (idx == 0) {
+        unshare(cur_node);
+      }
+      stack.push_back({&mparse::get_child_slot(*cur_node, idx), 0});
+    } else {
+      stack.pop_back();
+      func(cur_node);
+    }
+  }
 }
 
 
@@ -117,8 +397,10 @@ template <typename... Ts>
 bool apply_rewriters_top_down(mparse::ast_node_ptr& node,
                               const rewriter_list<Ts...>& list) {
   bool ret = false;
-  apply_top_down(node, [&](mparse::ast_node_ptr& cur_node) {
-    ret |= apply_rewriters(cur_node, list);
+  impl::with_rewriters(list, [&](auto&& apply) {
+    apply_top_down(node, [&](mparse::ast_node_ptr& cur_node) {
+      ret |= apply(cur_node);
+    });
   });
   return ret;
 }
@@ -127,8 +409,10 @@ template <typename... Ts>
 bool apply_rewriters_bottom_up(mparse::ast_node_ptr& node,
                                const rewriter_list<Ts...>& list) {
   bool ret = false;
-  apply_bottom_up(node, [&](mparse::ast_node_ptr& cur_node) {
-    ret |= apply_rewriters(cur_node, list);
+  impl::with_rewriters(list, [&](auto&& apply) {
+    apply_bottom_up(node, [&](mparse::ast_node_ptr& cur_node) {
+      ret |= apply(cur_node);
+    });
   });
   return ret;
 }
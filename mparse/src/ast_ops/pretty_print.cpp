@@ -1,11 +1,16 @@
 #include "pretty_print.h"
 
 #include "mparse/ast.h"
+#include "mparse/traversal.h"
 #include "op_strings.h"
-#include "util/auto_restore.h"
-#include <iomanip>
-#include <limits>
-#include <sstream>
+#include <algorithm>
+#include <charconv>
+#include <cstddef>
+#include <initializer_list>
+#include <string>
+#include <iterator>
+#include <string_view>
+#include <vector>
 
 using namespace std::literals;
 
@@ -83,10 +88,73 @@ bool should_parenthesize(op_precedence parent_precedence,
   return static_cast<int>(precedence) < static_cast<int>(parent_precedence);
 }
 
+// Formats `val` with 16 significant digits, as printed before, but always in
+// fixed notation: the lexer does not accept exponents.
+std::string format_literal(double val) {
+  char buf[32]; // "-d.ddddddddddddddde-308"
+  char* end = std::to_chars(std::begin(buf), std::end(buf), val,
+                            std::chars_format::scientific, 15)
+                  .ptr;
+
+  std::string_view sci(buf, static_cast<std::size_t>(end - buf));
+  std::size_t exp_pos = sci.find('e');
+
+  int exp = 0;
+  std::from_chars(sci.data() + exp_pos + 1 + (sci[exp_pos + 1] == '+'), end,
+                  exp);
+
+  std::string ret;
+  std::string_view mant = sci.substr(0, exp_pos);
+  if (mant.front() == '-') {
+    ret += '-';
+    mant.remove_prefix(1);
+  }
+
+  // significant digits, without the point and trailing zeros
+  std::string digits;
+  digits += mant.front();
+  digits += mant.substr(2);
+  digits.erase(digits.find_last_not_of('0') + 1);
+  if (digits.empty()) {
+    digits = "0";
+  }
+
+  if (exp < 0) {
+    ret += "0.";
+    ret.append(static_cast<std::size_t>(-exp - 1), '0');
+    ret += digits;
+  } else if (static_cast<std::size_t>(exp) + 1 >= digits.size()) {
+    ret += digits;
+    ret.append(exp + 1 - digits.size(), '0');
+  } else {
+    ret.append(digits, 0, exp + 1);
+    ret += '.';
+    ret.append(digits, exp + 1);
+  }
+
+  return ret;
+}
 
-struct print_visitor : mparse::const_ast_visitor<print_visitor> {
-  explicit print_visitor(mparse::source_map* smap) : smap(smap) {}
 
+struct print_visitor : mparse::const_ast_visitor<print_visitor>,
+                       mparse::ast_traversal<print_visitor> {
+  // Printing state of a node whose children are being printed
+  struct frame {
+    std::size_t begin;
+    bool parenthesized = false;
+    mparse::source_range op_loc;
+    mparse::source_range name_loc;
+    mparse::source_range open_loc;
+  };
+
+  print_visitor(print_sink& sink, mparse::source_map* smap)
+      : sink(sink), smap(smap) {}
+
+  void enter(const mparse::ast_node& node);
+  void enter_child(const mparse::ast_node& parent, std::size_t idx);
+  void leave(const mparse::ast_node& node);
+
+  // invoked when leaving nodes
   void operator()(const mparse::paren_node& node);
   void operator()(const mparse::abs_node& node);
   void operator()(const mparse::unary_op_node& node);
@@ -95,197 +163,196 @@ struct print_visitor : mparse::const_ast_visitor<print_visitor> {
   void operator()(const mparse::literal_node& node);
   void operator()(const mparse::id_node& node);
 
+  void open_paren(op_precedence precedence);
+  void close_paren();
+
+  void set_child_context(op_precedence parent_precedence,
+                         associativity parent_assoc, branch_side side);
+
+  void write(std::string_view str) {
+    sink.write(str);
+    pos += str.size();
+  }
+
   void set_locs(const mparse::ast_node& node,
-                std::vector<mparse::source_range> locs);
+                std::initializer_list<mparse::source_range> locs);
 
   template <typename F>
-  mparse::source_range record_loc(F&& f) const {
-    std::size_t begin = result.size();
+  mparse::source_range record_loc(F&& f) {
+    std::size_t begin = pos;
     std::forward<F>(f)();
-    std::size_t end = result.size();
+    std::size_t end = pos;
 
     return {begin, end};
   }
 
+  mparse::source_range pop_expr_loc();
+
   op_precedence parent_precedence = op_precedence::unknown;
   bool assoc_paren =
       should_parenthesize_assoc(branch_side::none, associativity::none);
 
-  mparse::source_map* smap;
-  std::string result;
-};
+  std::vector<frame> frames;
 
+  print_sink& sink;
+  std::size_t pos = 0;
 
-class auto_parenthesizer {
-public:
-  auto_parenthesizer(print_visitor& vis, op_precedence precedence);
-  ~auto_parenthesizer();
-
-private:
-  std::string& expr_;
-  bool parenthesize_;
+  mparse::source_map* smap;
 };
 
-auto_parenthesizer::auto_parenthesizer(print_visitor& vis,
-                                       op_precedence precedence)
-    : expr_(vis.result),
-      parenthesize_(should_parenthesize(vis.parent_precedence, precedence,
-                                        vis.assoc_paren)) {
-  if (parenthesize_) {
-    expr_ += "(";
+
+void print_visitor::enter(const mparse::ast_node& node) {
+  frames.push_back({pos, false, {}, {}, {}});
+
+  if (mparse::ast_node_cast<const mparse::paren_node>(&node)) {
+    write("(");
+  } else if (mparse::ast_node_cast<const mparse::abs_node>(&node)) {
+    write("|");
+  } else if (auto* unary_node =
+                 mparse::ast_node_cast<const mparse::unary_op_node>(&node)) {
+    open_paren(op_precedence::unary);
+    frames.back().op_loc = record_loc(
+        [&] { write(stringify_unary_op(unary_node->type())); });
+  } else if (auto* binary_node =
+                 mparse::ast_node_cast<const mparse::binary_op_node>(&node)) {
+    open_paren(get_precedence(binary_node->type()));
+  } else if (auto* func_node =
+                 mparse::ast_node_cast<const mparse::func_node>(&node)) {
+    frame& cur = frames.back();
+    cur.name_loc = record_loc([&] { write(func_node->name()); });
+    cur.open_loc = record_loc([&] { write("("); });
   }
 }
 
-auto_parenthesizer::~auto_parenthesizer() {
-  if (parenthesize_) {
-    expr_ += ")";
+void print_visitor::enter_child(const mparse::ast_node& parent,
+                                std::size_t idx) {
+  if (mparse::ast_node_cast<const mparse::unary_op_node>(&parent)) {
+    set_child_context(op_precedence::unary, associativity::none,
+                      branch_side::none);
+  } else if (auto* binary_node =
+                 mparse::ast_node_cast<const mparse::binary_op_node>(
+                     &parent)) {
+    op_precedence prec = get_precedence(binary_node->type());
+    associativity assoc = get_associativity(binary_node->type());
+
+    if (idx == 0) {
+      set_child_context(prec, assoc, branch_side::left);
+    } else {
+      write(" ");
+      frames.back().op_loc = record_loc(
+          [&] { write(stringify_binary_op(binary_node->type())); });
+      write(" ");
+
+      set_child_context(prec, assoc, branch_side::right);
+    }
+  } else {
+    if (idx > 0) { // function arguments
+      write(", ");
+    }
+    set_child_context(op_precedence::unknown, associativity::none,
+                      branch_side::none);
   }
 }
 
-
-class child_visitor_scope {
-public:
-  child_visitor_scope(print_visitor& vis, op_precedence parent_precedence,
-                      associativity parent_assoc, branch_side side);
-
-private:
-  util::auto_restore<op_precedence> restore_precedence_;
-  util::auto_restore<bool> restore_assoc_paren_;
-};
-
-child_visitor_scope::child_visitor_scope(print_visitor& vis,
-                                         op_precedence parent_precedence,
-                                         associativity parent_assoc,
-                                         branch_side side)
-    : restore_precedence_(vis.parent_precedence, parent_precedence),
-      restore_assoc_paren_(vis.assoc_paren,
-                           should_parenthesize_assoc(side, parent_assoc)) {}
+void print_visitor::leave(const mparse::ast_node& node) {
+  mparse::apply_visitor(*this, node);
+}
 
 
 void print_visitor::operator()(const mparse::paren_node& node) {
-  mparse::source_range loc = record_loc([&] {
-    result += "(";
-    {
-      child_visitor_scope scope(*this, op_precedence::unknown,
-                                associativity::none, branch_side::none);
-      mparse::apply_visitor(*this, *node.child());
-    }
-    result += ")";
-  });
-
-  set_locs(node, {loc});
+  write(")");
+  set_locs(node, {pop_expr_loc()});
 }
 
 void print_visitor::operator()(const mparse::abs_node& node) {
-  mparse::source_range loc = record_loc([&] {
-    result += "|";
-    {
-      child_visitor_scope scope(*this, op_precedence::unknown,
-                                associativity::none, branch_side::none);
-      mparse::apply_visitor(*this, *node.child());
-    }
-    result += "|";
-  });
-
-  set_locs(node, {loc});
+  write("|");
+  set_locs(node, {pop_expr_loc()});
 }
 
 void print_visitor::operator()(const mparse::unary_op_node& node) {
-  mparse::source_range op_loc;
-  mparse::source_range expr_loc = record_loc([&] {
-    auto_parenthesizer paren(*this, op_precedence::unary);
+  close_paren();
 
-    op_loc = record_loc([&] { result += stringify_unary_op(node.type()); });
-
-    child_visitor_scope scope(*this, op_precedence::unary, associativity::none,
-                              branch_side::none);
-    mparse::apply_visitor(*this, *node.child());
-  });
-
-  set_locs(node, {expr_loc, op_loc});
+  mparse::source_range op_loc = frames.back().op_loc;
+  set_locs(node, {pop_expr_loc(), op_loc});
 }
 
 void print_visitor::operator()(const mparse::binary_op_node& node) {
-  op_precedence prec = get_precedence(node.type());
-  associativity assoc = get_associativity(node.type());
+  close_paren();
 
-  mparse::source_range op_loc;
-  mparse::source_range expr_loc = record_loc([&] {
-    auto_parenthesizer paren(*this, prec);
+  mparse::source_range op_loc = frames.back().op_loc;
+  set_locs(node, {pop_expr_loc(), op_loc});
+}
 
-    {
-      child_visitor_scope scope(*this, prec, assoc, branch_side::left);
-      mparse::apply_visitor(*this, *node.lhs());
-    }
+void print_visitor::operator()(const mparse::func_node& node) {
+  write(")");
 
-    result += " ";
-    op_loc = record_loc([&] { result += stringify_binary_op(node.type()); });
-    result += " ";
+  frame cur = frames.back();
+  set_locs(node, {pop_expr_loc(), cur.name_loc, cur.open_loc});
+}
 
-    {
-      child_visitor_scope scope(*this, prec, assoc, branch_side::right);
-      mparse::apply_visitor(*this, *node.rhs());
-    }
-  });
+void print_visitor::operator()(const mparse::literal_node& node) {
+  write(format_literal(node.val()));
+  set_locs(node, {pop_expr_loc()});
+}
 
-  set_locs(node, {expr_loc, op_loc});
+void print_visitor::operator()(const mparse::id_node& node) {
+  write(node.name());
+  set_locs(node, {pop_expr_loc()});
 }
 
-void print_visitor::operator()(const mparse::func_node& node) {
-  mparse::source_range name_loc, open_loc;
-  mparse::source_range expr_loc = record_loc([&] {
-    name_loc = record_loc([&] { result += node.name(); });
-    open_loc = record_loc([&] { result += "("; });
-
-    {
-      child_visitor_scope scope(*this, op_precedence::unknown,
-                                associativity::none, branch_side::none);
-      for (const auto& arg : node.args()) {
-        if (arg != node.args().front()) {
-          result += ", ";
-        }
-        mparse::apply_visitor(*this, *arg);
-      }
-    }
 
-    result += ")";
-  });
+void print_visitor::open_paren(op_precedence precedence) {
+  frame& cur = frames.back();
+  cur.parenthesized =
+      should_parenthesize(parent_precedence, precedence, assoc_paren);
 
-  set_locs(node, {expr_loc, name_loc, open_loc});
+  if (cur.parenthesized) {
+    write("(");
+  }
 }
 
-void print_visitor::operator()(const mparse::literal_node& node) {
-  std::ostringstream stream;
-  stream << std::setprecision(std::numeric_limits<double>::digits10 + 1)
-         << node.val();
-
-  mparse::source_range loc = record_loc([&] { result += stream.str(); });
-
-  set_locs(node, {loc});
+void print_visitor::close_paren() {
+  if (frames.back().parenthesized) {
+    write(")");
+  }
 }
 
-void print_visitor::operator()(const mparse::id_node& node) {
-  mparse::source_range loc = record_loc([&] { result += node.name(); });
 
-  set_locs(node, {loc});
+void print_visitor::set_child_context(op_precedence parent_precedence,
+                                      associativity parent_assoc,
+                                      branch_side side) {
+  this->parent_precedence = parent_precedence;
+  assoc_paren = should_parenthesize_assoc(side, parent_assoc);
 }
 
-
 void print_visitor::set_locs(const mparse::ast_node& node,
-                             std::vector<mparse::source_range> locs) {
+                             std::initializer_list<mparse::source_range> locs) {
   if (smap) {
-    smap->set_locs(&node, std::move(locs));
+    smap->set_locs(&node, locs);
   }
 }
 
+mparse::source_range print_visitor::pop_expr_loc() {
+  std::size_t begin = frames.back().begin;
+  frames.pop_back();
+  return {begin, pos};
+}
+
 } // namespace
 
 
+void pretty_print_to(print_sink& sink, const mparse::ast_node& node,
+                     mparse::source_map* smap) {
+  print_visitor vis(sink, smap);
+  mparse::traverse(vis, node);
+}
+
 std::string pretty_print(const mparse::ast_node& node,
                          mparse::source_map* smap) {
-  print_visitor vis(smap);
-  mparse::apply_visitor(vis, node);
-  return vis.result;
+  std::string result;
+  string_sink sink(result);
+  pretty_print_to(sink, node, smap);
+  return result;
 }
 
 } // namespace ast_ops
\ No newline at end of file
@@ -2,10 +2,52 @@
 
 #include "mparse/ast.h"
 #include "mparse/source_map.h"
+#include <cstdio>
 #include <string>
+#include <string_view>
 
 namespace ast_ops {
 
+// Destination for printed expressions. Output is delivered in small pieces, so
+// implementations should buffer if writes are expensive.
+class print_sink {
+public:
+  virtual void write(std::string_view str) = 0;
+
+protected:
+  ~print_sink() = default;
+};
+
+// Appends to an existing string, reusing its capacity.
+class string_sink final : public print_sink {
+public:
+  explicit string_sink(std::string& buf) : buf_(buf) {}
+
+  void write(std::string_view str) override { buf_ += str; }
+
+private:
+  std::string& buf_;
+};
+
+// Writes through stdio, relying on the stream's own buffering.
+class file_sink final : public print_sink {
+public:
+  explicit file_sink(std::FILE* file) : file_(file) {}
+
+  void write(std::string_view str) override {
+    std::fwrite(str.data(), 1, str.size(), file_);
+  }
+
+private:
+  std::FILE* file_;
+};
+
+
+// Locations recorded in `smap` are relative to the start of this call's
+// output.
+void pretty_print_to(print_sink& sink, const mparse::ast_node& ast,
+                     mparse::source_map* smap = nullptr);
+
 std::string pretty_print(const mparse::ast_node& ast,
                          mparse::source_map* smap = nullptr);
 
@@ -0,0 +1,319 @@
+#include "serialize.h"
+
+#include "mparse/traversal.h"
+#include <bit>
+#include <unordered_map>
+#include <utility>
+
+namespace ast_ops {
+namespace {
+
+constexpr std::string_view magic = "MPAB";
+
+
+void write_byte(std::string& out, std::uint8_t byte) {
+  out.push_back(static_cast<char>(byte));
+}
+
+void write_varint(std::string& out, std::uint64_t val) {
+  while (val >= 0x80) {
+    write_byte(out, static_cast<std::uint8_t>(val | 0x80));
+    val >>= 7;
+  }
+  write_byte(out, static_cast<std::uint8_t>(val));
+}
+
+void write_double(std::string& out, double val) {
+  auto bits = std::bit_cast<std::uint64_t>(val);
+  for (int i = 0; i < 8; i++) {
+    write_byte(out, static_cast<std::uint8_t>(bits >> (8 * i)));
+  }
+}
+
+
+[[noreturn]] void throw_truncated() {
+  throw serialization_error("Unexpected end of serialized AST");
+}
+
+std::uint8_t read_byte(std::string_view data, std::size_t& pos) {
+  if (pos == data.size()) {
+    throw_truncated();
+  }
+  return static_cast<std::uint8_t>(data[pos++]);
+}
+
+std::uint64_t read_varint(std::string_view data, std::size_t& pos) {
+  std::uint64_t val = 0;
+
+  for (int shift = 0; shift < 64; shift += 7) {
+    std::uint8_t byte = read_byte(data, pos);
+    val |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+
+    if (!(byte & 0x80)) {
+      return val;
+    }
+  }
+
+  throw serialization_error("Varint too long");
+}
+
+double read_double(std::string_view data, std::size_t& pos) {
+  if (data.size() - pos < 8) {
+    throw_truncated();
+  }
+
+  std::uint64_t bits = 0;
+  for (int i = 0; i < 8; i++) {
+    bits |= static_cast<std::uint64_t>(read_byte(data, pos)) << (8 * i);
+  }
+  return std::bit_cast<double>(bits);
+}
+
+
+struct serialize_visitor : mparse::const_ast_visitor<serialize_visitor>,
+                           mparse::ast_traversal<serialize_visitor> {
+  void enter(const mparse::ast_node& node) {
+    mparse::apply_visitor(*this, node);
+  }
+
+  void operator()(const mparse::paren_node&) { write_op(serialized_op::paren); }
+
+  void operator()(const mparse::abs_node&) { write_op(serialized_op::abs); }
+
+  void operator()(const mparse::unary_op_node& node) {
+    switch (node.type()) {
+    case mparse::unary_op_type::plus:
+      write_op(serialized_op::plus);
+      break;
+    case mparse::unary_op_type::neg:
+      write_op(serialized_op::neg);
+      break;
+    }
+  }
+
+  void operator()(const mparse::binary_op_node& node) {
+    switch (node.type()) {
+    case mparse::binary_op_type::add:
+      write_op(serialized_op::add);
+      break;
+    case mparse::binary_op_type::sub:
+      write_op(serialized_op::sub);
+      break;
+    case mparse::binary_op_type::mult:
+      write_op(serialized_op::mult);
+      break;
+    case mparse::binary_op_type::div:
+      write_op(serialized_op::div);
+      break;
+    case mparse::binary_op_type::pow:
+      write_op(serialized_op::pow);
+      break;
+    }
+  }
+
+  void operator()(const mparse::func_node& node) {
+    write_op(serialized_op::func);
+    write_varint(nodes, intern(node.name()));
+    write_varint(nodes, node.args().size());
+  }
+
+  void operator()(const mparse::literal_node& node) {
+    write_op(serialized_op::literal);
+    write_double(nodes, node.val());
+  }
+
+  void operator()(const mparse::id_node& node) {
+    write_op(serialized_op::id);
+    write_varint(nodes, intern(node.name()));
+  }
+
+  void write_op(serialized_op op) {
+    write_byte(nodes, static_cast<std::uint8_t>(op));
+  }
+
+  std::size_t intern(std::string_view str) {
+    auto [it, inserted] = string_indices.try_emplace(str, strings.size());
+    if (inserted) {
+      strings.push_back(str);
+    }
+    return it->second;
+  }
+
+  // views into the tree being serialized
+  std::vector<std::string_view> strings;
+  std::unordered_map<std::string_view, std::size_t> string_indices;
+
+  std::string nodes;
+};
+
+} // namespace
+
+
+serialized_node serialized_ast::reader::next() {
+  std::string_view data = ast_->data_;
+
+  auto read_name = [&] {
+    std::uint64_t idx = read_varint(data, pos_);
+    if (idx >= ast_->strings_.size()) {
+      throw serialization_error("String index out of range");
+    }
+    return ast_->strings_[idx];
+  };
+
+  serialized_node node;
+  node.op = static_cast<serialized_op>(read_byte(data, pos_));
+
+  switch (node.op) {
+  case serialized_op::paren:
+  case serialized_op::abs:
+  case serialized_op::plus:
+  case serialized_op::neg:
+    node.child_count = 1;
+    break;
+
+  case serialized_op::add:
+  case serialized_op::sub:
+  case serialized_op::mult:
+  case serialized_op::div:
+  case serialized_op::pow:
+    node.child_count = 2;
+    break;
+
+  case serialized_op::func:
+    node.name = read_name();
+    node.child_count = read_varint(data, pos_);
+    break;
+
+  case serialized_op::literal:
+    node.val = read_double(data, pos_);
+    break;
+
+  case serialized_op::id:
+    node.name = read_name();
+    break;
+
+  default:
+    throw serialization_error("Invalid opcode");
+  }
+
+  return node;
+}
+
+
+serialized_ast::serialized_ast(std::string_view data) : data_(data) {
+  if (!data.starts_with(magic)) {
+    throw serialization_error("Not a serialized AST");
+  }
+
+  std::size_t pos = magic.size();
+  if (read_byte(data, pos) > version) {
+    throw serialization_error("Unsupported serialized AST version");
+  }
+
+  std::uint64_t string_count = read_varint(data, pos);
+  for (std::uint64_t i = 0; i < string_count; i++) {
+    std::uint64_t len = read_varint(data, pos);
+    if (data.size() - pos < len) {
+      throw_truncated();
+    }
+
+    strings_.push_back(data.substr(pos, len));
+    pos += len;
+  }
+
+  nodes_begin_ = pos;
+}
+
+
+std::string serialize(const mparse::ast_node& node) {
+  serialize_visitor vis;
+  mparse::traverse(vis, node);
+
+  std::string out(magic);
+  write_byte(out, serialized_ast::version);
+
+  write_varint(out, vis.strings.size());
+  for (std::string_view str : vis.strings) {
+    write_varint(out, str.size());
+    out += str;
+  }
+
+  out += vis.nodes;
+  return out;
+}
+
+mparse::ast_node_ptr deserialize(const serialized_ast& ast) {
+  std::vector<mparse::ast_node_ptr> built;
+
+  auto pop_built = [&] {
+    mparse::ast_node_ptr node = std::move(built.back());
+    built.pop_back();
+    return node;
+  };
+
+  auto make_binary = [&](mparse::binary_op_type type) {
+    mparse::ast_node_ptr rhs = pop_built();
+    mparse::ast_node_ptr lhs = pop_built();
+    return mparse::make_ast_node<mparse::binary_op_node>(type, std::move(lhs),
+                                                         std::move(rhs));
+  };
+
+  auto leave = [&](const serialized_node& node) {
+    mparse::ast_node_ptr ret;
+
+    switch (node.op) {
+    case serialized_op::paren:
+      ret = mparse::make_ast_node<mparse::paren_node>(pop_built());
+      break;
+    case serialized_op::abs:
+      ret = mparse::make_ast_node<mparse::abs_node>(pop_built());
+      break;
+    case serialized_op::plus:
+      ret = mparse::make_ast_node<mparse::unary_op_node>(
+          mparse::unary_op_type::plus, pop_built());
+      break;
+    case serialized_op::neg:
+      ret = mparse::make_ast_node<mparse::unary_op_node>(
+          mparse::unary_op_type::neg, pop_built());
+      break;
+    case serialized_op::add:
+      ret = make_binary(mparse::binary_op_type::add);
+      break;
+    case serialized_op::sub:
+      ret = make_binary(mparse::binary_op_type::sub);
+      break;
+    case serialized_op::mult:
+      ret = make_binary(mparse::binary_op_type::mult);
+      break;
+    case serialized_op::div:
+      ret = make_binary(mparse::binary_op_type::div);
+      break;
+    case serialized_op::pow:
+      ret = make_binary(mparse::binary_op_type::pow);
+      break;
+    case serialized_op::func: {
+      mparse::func_node::arg_list args(
+          std::make_move_iterator(built.end() - node.child_count),
+          std::make_move_iterator(built.end()));
+      built.resize(built.size() - node.child_count);
+
+      ret = mparse::make_ast_node<mparse::func_node>(std::string(node.name),
+                                                     std::move(args));
+      break;
+    }
+    case serialized_op::literal:
+      ret = mparse::make_ast_node<mparse::literal_node>(node.val);
+      break;
+    case serialized_op::id:
+      ret = mparse::make_ast_node<mparse::id_node>(std::string(node.name));
+      break;
+    }
+
+    built.push_back(std::move(ret));
+  };
+
+  fold_serialized(ast, [](const serialized_node&) {}, leave);
+  return pop_built();
+}
+
+} // namespace ast_ops
\ No newline at end of file
@@ -0,0 +1,119 @@
+#pragma once
+
+#include "mparse/ast.h"
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace ast_ops {
+
+// Binary AST format, all integers little-endian:
+//  - header: the magic "MPAB" followed by a version byte
+//  - string table: varint count, then each string as a varint length and its
+//    bytes; names of identifiers and functions refer to it by index
+//  - nodes in pre-order, each an opcode byte followed by its operands:
+//    `func` has a varint name index and a varint argument count, `literal` a
+//    raw IEEE double and `id` a varint name index
+enum class serialized_op : std::uint8_t {
+  paren,
+  abs,
+  plus,
+  neg,
+  add,
+  sub,
+  mult,
+  div,
+  pow,
+  func,
+  literal,
+  id,
+};
+
+class serialization_error : public std::runtime_error {
+public:
+  using runtime_error::runtime_error;
+};
+
+
+struct serialized_node {
+  serialized_op op;
+  std::size_t child_count = 0;
+  double val = 0;        // literals only
+  std::string_view name; // functions and identifiers only
+};
+
+// View of a serialized AST, reading directly from the underlying buffer
+// (which must outlive it). Only the header and string table are examined up
+// front; malformed nodes are reported as they are read.
+class serialized_ast {
+public:
+  static constexpr std::uint8_t version = 1;
+
+  // Sequential reader yielding nodes in pre-order.
+  class reader {
+  public:
+    bool at_end() const { return pos_ == ast_->data_.size(); }
+    serialized_node next();
+
+  private:
+    friend serialized_ast;
+
+    reader(const serialized_ast& ast, std::size_t pos)
+        : ast_(&ast), pos_(pos) {}
+
+    const serialized_ast* ast_;
+    std::size_t pos_;
+  };
+
+  explicit serialized_ast(std::string_view data);
+
+  reader read() const { return {*this, nodes_begin_}; }
+
+private:
+  std::string_view data_;
+  std::vector<std::string_view> strings_;
+  std::size_t nodes_begin_;
+};
+
+
+// Generic bottom-up fold over a serialized AST. `enter(node)` is invoked on
+// each node in pre-order, and `leave(node)` once all of its children have been
+// left. Checks that the data holds exactly one well-formed tree.
+template <typename Enter, typename Leave>
+void fold_serialized(const serialized_ast& ast, Enter&& enter, Leave&& leave) {
+  struct frame {
+    serialized_node node;
+    std::size_t remaining;
+  };
+
+  std::vector<frame> frames;
+  serialized_ast::reader reader = ast.read();
+
+  while (true) {
+    serialized_node node = reader.next();
+    enter(node);
+    frames.push_back({node, node.child_count});
+
+    while (frames.back().remaining == 0) {
+      leave(frames.back().node);
+      frames.pop_back();
+
+      if (frames.empty()) {
+        if (!reader.at_end()) {
+          throw serialization_error("Trailing data after serialized AST");
+        }
+        return;
+      }
+      frames.back().remaining--;
+    }
+  }
+}
+
+
+std::string serialize(const mparse::ast_node& node);
+mparse::ast_node_ptr deserialize(const serialized_ast& ast);
+
+} // namespace ast_ops
\ No newline at end of file
@@ -2,7 +2,11 @@
 
 #include "ast_ops/eval/eval.h"
 #include "mparse/ast.h"
+#include "mparse/traversal.h"
 #include <algorithm>
+#include <exception>
+#include <optional>
+#include <vector>
 
 using namespace ast_ops::matching::literals;
 
@@ -119,11 +123,15 @@ bool eval_funcs(mparse::ast_node_ptr& node, const func_scope& fscope) {
   matching::apply_bottom_up(node, [&](mparse::ast_node_ptr& cur_node) {
     if (auto* func_node =
             mparse::ast_node_cast<const mparse::func_node>(cur_node.get())) {
-      if (has_constant_args(func_node) &&
-          fscope.parent()->lookup(func_node->name())) {
-        cur_node = build_cmplx_lit(eval(*cur_node, {}, fscope));
-        changed = true;
-      }
+      changed |= matching::record_rule(0, [&] {
+        if (has_constant_args(func_node) &&
+            fscope.parent()->lookup(func_node->name())) {
+          cur_node = build_cmplx_lit(eval(*cur_node, {}, fscope));
+          matching::record_built(cur_node);
+          return true;
+        }
+        return false;
+      });
     }
   });
 
@@ -216,40 +224,276 @@ constexpr matching::rewriter_list simp_rewriters = {
 
 // clang-format on
 
-} // namespace
 
+struct budget_exhausted {};
 
-void simplify(mparse::ast_node_ptr& node, const var_scope& vscope,
-              const func_scope& fscope) {
-  func_scope eval_fscope = lit_eval_fscope();
-  eval_fscope.set_parent(&fscope);
+class budget_monitor final : public matching::rewrite_monitor {
+public:
+  explicit budget_monitor(const simplify_budget& budget) : budget_(budget) {}
 
-  canonicalize(node);
-  run_with_cmplx_lits(node, [&] {
-    propagate_vars(node, vscope);
+  simplify_status status() const { return status_; }
+
+  void on_rule(bool rewritten) override {
+    if (status_ != simplify_status::complete) {
+      return; // already exhausted, the traversal is being unwound
+    }
+
+    // the rule has already been applied, so stop right after the last one
+    // allowed
+    if (rewritten && ++rewrites_ >= budget_.max_rewrites) {
+      exhaust(simplify_status::rewrite_limit);
+    }
 
-    bool has_work = true;
-    while (has_work) {
+    // the clock is only read every so often while nothing changes
+    if (!rewritten && ++idle_attempts_ % deadline_check_interval != 0) {
+      return;
+    }
+
+    if (budget_.cancel && budget_.cancel->load(std::memory_order_relaxed)) {
+      exhaust(simplify_status::cancelled);
+    }
+
+    if (std::chrono::steady_clock::now() >= budget_.deadline) {
+      exhaust(simplify_status::deadline);
+    }
+  }
+
+  void check_size(const mparse::ast_node& node) {
+    if (budget_.max_nodes == std::numeric_limits<std::size_t>::max()) {
+      return;
+    }
+
+    struct node_counter : mparse::ast_traversal<node_counter> {
+      void enter(const mparse::ast_node&) { count++; }
+      std::size_t count = 0;
+    } counter;
+
+    mparse::traverse(counter, node);
+    if (counter.count > budget_.max_nodes) {
+      exhaust(simplify_status::node_limit);
+    }
+  }
+
+private:
+  static constexpr std::size_t deadline_check_interval = 256;
+
+  [[noreturn]] void exhaust(simplify_status status) {
+    status_ = status;
+    throw budget_exhausted{};
+  }
+
+  const simplify_budget& budget_;
+  simplify_status status_ = simplify_status::complete;
+
+  std::size_t rewrites_ = 0;
+  std::size_t idle_attempts_ = 0;
+};
+
+
+// Runs simplification passes on a canonicalized tree with complex literals
+// until a fixed point is reached.
+void simplify_lits(mparse::ast_node_ptr& node, const func_scope& eval_fscope,
+                   budget_monitor* monitor) {
+  std::optional<matching::monitor_scope> watch;
+  if (monitor) {
+    watch.emplace(*monitor);
+  }
+
+  auto end_pass = [&] {
+    if (monitor) {
+      monitor->check_size(*node);
+    }
+  };
+
+  bool has_work = true;
+  while (has_work) {
+    if (auto* stats = matching::active_stats()) {
+      stats->iterations++;
+    }
+
+    {
+      matching::stats_pass pass("const_eval_rewriters");
       has_work =
           matching::apply_rewriters_bottom_up(node, const_eval_rewriters);
+      end_pass();
+    }
 
+    {
+      matching::stats_pass pass("eval_funcs");
       has_work |= eval_funcs(node, eval_fscope);
+      end_pass();
+    }
 
+    {
+      matching::stats_pass pass("const_migrate_rewriters");
       has_work |=
           matching::apply_rewriters_bottom_up(node, const_migrate_rewriters);
+      end_pass();
+    }
 
+    {
+      matching::stats_pass pass("reassoc_rewriters");
       while (matching::apply_rewriters_top_down(node, reassoc_rewriters)) {
         has_work = true;
+        end_pass();
       }
+    }
 
+    {
+      matching::stats_pass pass("simp_rewriters");
       while (matching::apply_rewriters_bottom_up(node, simp_rewriters)) {
         has_work = true;
+        end_pass();
+      }
+    }
+  }
+}
+
+
+// The rules never look into the arguments of a function call, and only replace
+// a call once all of its arguments are constant. Large arguments can thus be
+// simplified on their own before the tree as a whole, independently of each
+// other.
+constexpr std::size_t min_independent_size = 1024;
+
+// Returns the slots of all large function arguments, grouped into levels such
+// that each argument only contains ones from earlier levels. `can_share_work`
+// is cleared if the tree contains shared nodes, which must not be unshared
+// concurrently.
+std::vector<std::vector<mparse::ast_node_ptr*>> find_independent_subtrees(
+    mparse::ast_node_ptr& root, bool& can_share_work) {
+  struct frame {
+    mparse::ast_node_ptr* slot;
+    std::size_t next_child = 0;
+    std::size_t size = 1;
+    std::size_t level = 0; // levels of the arguments contained
+  };
+
+  std::vector<std::vector<mparse::ast_node_ptr*>> levels;
+  std::vector<frame> stack = {{&root}};
+
+  while (true) {
+    frame& top = stack.back();
+    mparse::ast_node& node = **top.slot;
+
+    if (top.next_child < mparse::child_count(node)) {
+      auto& child = mparse::get_child_slot(node, top.next_child++);
+      if (child.use_count() > 1) {
+        can_share_work = false;
+      }
+
+      stack.push_back({&child});
+      continue;
+    }
+
+    frame done = stack.back();
+    stack.pop_back();
+    if (stack.empty()) {
+      return levels;
+    }
+
+    frame& parent = stack.back();
+    if (done.size >= min_independent_size &&
+        mparse::ast_node_cast<mparse::func_node>(parent.slot->get())) {
+      if (levels.size() <= done.level) {
+        levels.emplace_back();
       }
+      levels[done.level++].push_back(done.slot);
+    }
+
+    parent.size += done.size;
+    parent.level = std::max(parent.level, done.level);
+  }
+}
+
+// Simplifies the subtrees in `slots`, concurrently if `pool` is set. All
+// of them are processed even if some fail, in which case the first error is
+// rethrown, so that the outcome never depends on the number of threads.
+void simplify_independent(const std::vector<mparse::ast_node_ptr*>& slots,
+                          const func_scope& eval_fscope,
+                          budget_monitor* monitor, util::thread_pool* pool) {
+  std::vector<std::exception_ptr> errors(slots.size());
+
+  auto simplify_one = [&](std::size_t idx) {
+    try {
+      simplify_lits(*slots[idx], eval_fscope, monitor);
+    } catch (const budget_exhausted&) {
+      throw; // only thrown when serial, stops everything
+    } catch (...) {
+      errors[idx] = std::current_exception();
     }
+  };
+
+  if (pool) {
+    pool->parallel_for(slots.size(), simplify_one);
+  } else {
+    for (std::size_t i = 0; i < slots.size(); i++) {
+      simplify_one(i);
+    }
+  }
+
+  for (const auto& error : errors) {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+}
+
+void simplify_tree(mparse::ast_node_ptr& node, const func_scope& eval_fscope,
+                   budget_monitor* monitor, util::thread_pool* pool) {
+  // monitors and statistics are per thread
+  bool parallel = pool && !monitor && !matching::active_stats();
+
+  for (const auto& level : find_independent_subtrees(node, parallel)) {
+    simplify_independent(level, eval_fscope, monitor,
+                         parallel ? pool : nullptr);
+  }
+
+  simplify_lits(node, eval_fscope, monitor);
+}
+
+} // namespace
+
+
+void simplify(mparse::ast_node_ptr& node, const var_scope& vscope,
+              const func_scope& fscope, util::thread_pool* pool) {
+  func_scope eval_fscope = lit_eval_fscope();
+  eval_fscope.set_parent(&fscope);
+
+  canonicalize(node);
+  run_with_cmplx_lits(node, [&] {
+    propagate_vars(node, vscope);
+    simplify_tree(node, eval_fscope, nullptr, pool);
   });
   uncanonicalize(node);
 }
 
+simplify_status simplify(mparse::ast_node_ptr& node, const var_scope& vscope,
+                         const func_scope& fscope,
+                         const simplify_budget& budget) {
+  if (budget.max_rewrites == 0) {
+    return simplify_status::rewrite_limit;
+  }
+
+  func_scope eval_fscope = lit_eval_fscope();
+  eval_fscope.set_parent(&fscope);
+
+  budget_monitor monitor(budget);
+
+  canonicalize(node);
+  try {
+    run_with_cmplx_lits(node, [&] {
+      propagate_vars(node, vscope);
+      simplify_tree(node, eval_fscope, &monitor, nullptr);
+    });
+  } catch (const budget_exhausted&) {
+    // every rewrite leaves a valid tree, so just stop where we are
+  }
+  uncanonicalize(node);
+
+  return monitor.status();
+}
+
 
 /* MATCHING UTILITIES */
 
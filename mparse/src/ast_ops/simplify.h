@@ -6,6 +6,11 @@
 #include "ast_ops/matching/rewrite.h"
 #include "mparse/ast.h"
 #include "util/finally.h"
+#include "util/parallel.h"
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <limits>
 #include <string_view>
 
 namespace ast_ops {
@@ -18,8 +23,40 @@ void canonicalize(mparse::ast_node_ptr& node);
 void uncanonicalize(mparse::ast_node_ptr& node);
 
 
+// If `pool` is given, large function arguments are simplified concurrently on
+// it, so functions in `fscope` must then be safe to call from several threads
+// at once.
 void simplify(mparse::ast_node_ptr& node, const var_scope& vscope = {},
-              const func_scope& fscope = {});
+              const func_scope& fscope = {}, util::thread_pool* pool = nullptr);
+
+
+// Limits on the work done by `simplify`, for callers that need bounded latency.
+// The tree size is checked between passes, the rest after every rule attempt.
+// Simplification stops as soon as `max_rewrites` rules have been applied, so
+// none are applied when it is zero.
+struct simplify_budget {
+  std::size_t max_rewrites = std::numeric_limits<std::size_t>::max();
+  std::size_t max_nodes = std::numeric_limits<std::size_t>::max();
+  std::chrono::steady_clock::time_point deadline =
+      std::chrono::steady_clock::time_point::max();
+
+  // cooperative cancellation: simplification stops once this is set
+  const std::atomic<bool>* cancel = nullptr;
+};
+
+enum class simplify_status {
+  complete,
+  rewrite_limit,
+  node_limit,
+  deadline,
+  cancelled,
+};
+
+// Simplifies `node` until done or until `budget` runs out. Either way, `node`
+// is left as a valid, uncanonicalized tree: the best result found so far.
+simplify_status simplify(mparse::ast_node_ptr& node, const var_scope& vscope,
+                         const func_scope& fscope,
+                         const simplify_budget& budget);
 
 
 inline namespace simp_matching {
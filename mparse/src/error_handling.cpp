@@ -98,6 +98,7 @@ void handle_math_error(const ast_ops::eval_error& err,
     handle_bad_func_call(err, smap, input);
     break;
   case ast_ops::eval_errc::out_of_range:
+  case ast_ops::eval_errc::no_derivative:
     print_math_error(err.what());
     print_locs(input, {smap.find_primary_loc(err.node())});
     break;
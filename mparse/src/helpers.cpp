@@ -1,7 +1,6 @@
 #include "helpers.h"
 
 #include "mparse/lex.h"
-#include <charconv>
 #include <cmath>
 #include <string>
 
@@ -36,7 +35,6 @@ void parse_vardefs(ast_ops::var_scope& vscope,
 
   do {
     std::string name;
-    double val;
 
     last_tok = get_token(stream);
     if (last_tok.type != mparse::token_type::ident) {
@@ -54,15 +52,11 @@ void parse_vardefs(ast_ops::var_scope& vscope,
       continue;
     }
 
-    auto status = std::from_chars(last_tok.val.data(),
-                                  last_tok.val.data() + last_tok.val.size(),
-                                  val, std::chars_format::fixed);
-
-    if (status.ec != std::errc{}) {
+    if (std::isnan(last_tok.num_val)) {
       continue;
     }
 
-    vscope.set_binding(std::move(name), val);
+    vscope.set_binding(std::move(name), last_tok.num_val);
   } while (last_tok.type != mparse::token_type::eof);
 }
 
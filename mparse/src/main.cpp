@@ -9,13 +9,16 @@
 #include "mparse/parse_error.h"
 #include "mparse/parser.h"
 #include "mparse/source_map.h"
+#include "util/parallel.h"
 #include "util/span.h"
 #include <functional>
 #include <iomanip>
 #include <iostream>
 #include <limits>
 #include <map>
+#include <optional>
 #include <utility>
+#include <vector>
 
 using namespace std::literals;
 
@@ -62,8 +65,8 @@ void print_help(std::string_view prog_name, const command_map& commands) {
 
 auto parse_diag(std::string_view input) {
   try {
-    mparse::source_map smap;
-    mparse::ast_node_ptr ast = mparse::parse(input, &smap);
+    mparse::ast_node_ptr ast = mparse::parse(input);
+    mparse::source_map smap(input, ast.get());
     return std::pair{std::move(ast), std::move(smap)};
   } catch (const mparse::syntax_error& err) {
     handle_syntax_error(err, input);
@@ -72,27 +75,34 @@ auto parse_diag(std::string_view input) {
 }
 
 
+void print_expr(const mparse::ast_node& node) {
+  ast_ops::file_sink sink(stdout);
+  ast_ops::pretty_print_to(sink, node);
+  std::cout << "\n";
+}
+
+
 void cmd_dump(subcommand_opts opts) {
   ast_ops::dump_ast(*opts.ast, &opts.smap);
 }
 
 void cmd_pretty(subcommand_opts opts) {
-  std::cout << ast_ops::pretty_print(*opts.ast) << "\n";
+  print_expr(*opts.ast);
 }
 
 void cmd_strip(subcommand_opts opts) {
   ast_ops::strip_parens(opts.ast);
-  std::cout << ast_ops::pretty_print(*opts.ast) << "\n";
+  print_expr(*opts.ast);
 }
 
 void cmd_paren(subcommand_opts opts) {
   ast_ops::strip_parens(opts.ast);
   ast_ops::insert_parens(opts.ast);
-  std::cout << ast_ops::pretty_print(*opts.ast) << "\n";
+  print_expr(*opts.ast);
 }
 
 void cmd_eval(subcommand_opts opts) {
-  auto vscope = ast_ops::builtin_var_scope();
+  ast_ops::var_scope vscope(&ast_ops::builtin_var_scope());
   parse_vardefs(vscope, opts.argv);
 
   try {
@@ -106,12 +116,34 @@ void cmd_eval(subcommand_opts opts) {
 }
 
 void cmd_simp(subcommand_opts opts) {
-  auto vscope = ast_ops::builtin_var_scope();
-  parse_vardefs(vscope, opts.argv);
+  std::vector<const char*> vardefs;
+  bool print_stats = false;
+
+  for (const char* arg : opts.argv) {
+    if (arg == "--stats"sv) {
+      print_stats = true;
+    } else {
+      vardefs.push_back(arg);
+    }
+  }
+
+  ast_ops::var_scope vscope(&ast_ops::builtin_var_scope());
+  parse_vardefs(vscope, vardefs);
 
   try {
-    ast_ops::simplify(opts.ast, vscope, ast_ops::builtin_func_scope());
-    std::cout << ast_ops::pretty_print(*opts.ast) << "\n";
+    ast_ops::matching::rewrite_stats stats;
+    std::optional<ast_ops::matching::stats_scope> collect_stats;
+    if (print_stats) {
+      collect_stats.emplace(stats);
+    }
+
+    util::thread_pool pool;
+    ast_ops::simplify(opts.ast, vscope, ast_ops::builtin_func_scope(), &pool);
+    print_expr(*opts.ast);
+
+    if (print_stats) {
+      stats.write_json(std::cerr);
+    }
   } catch (const ast_ops::eval_error& err) {
     mparse::source_map smap;
     std::string expr = ast_ops::pretty_print(*opts.ast, &smap);
@@ -141,7 +173,8 @@ int main(int argc, const char* const* argv) {
         cmd_eval}},
       {"simp",
        {"Simplify the expression, using passed variable definitions of the "
-        "form 'var1=val1 var2=val2'.",
+        "form 'var1=val1 var2=val2'. With '--stats', rewrite rule statistics "
+        "are written to stderr as JSON.",
         cmd_simp}},
   };
 
@@ -1,6 +1,45 @@
 #include "ast.h"
 
+#include <cassert>
+#include <vector>
+
 namespace mparse {
+namespace {
+
+// Detaches the children of `node` that would otherwise be destroyed along with
+// their own children. Leaves and shared children are left in place, as
+// releasing them cannot recurse.
+void take_children(ast_node& node, std::vector<ast_node_ptr>& pending) {
+  for (std::size_t i = 0; i < child_count(node); i++) {
+    auto& child = get_child_slot(node, i);
+    if (child && child.use_count() == 1 && child_count(*child) > 0) {
+      pending.push_back(std::move(child));
+    }
+  }
+}
+
+// Releases the children of a node that is being destroyed without recursing
+// into their destructors: whenever we hold the last reference to a child, its
+// own children are detached first, so that destroying it is a shallow
+// operation.
+void release_children(ast_node& node) {
+  std::vector<ast_node_ptr> pending;
+  take_children(node, pending);
+
+  while (!pending.empty()) {
+    ast_node_ptr cur = std::move(pending.back());
+    pending.pop_back();
+
+    take_children(*cur, pending);
+  }
+}
+
+} // namespace
+
+
+unary_node::~unary_node() {
+  release_children(*this);
+}
 
 void unary_node::set_child(ast_node_ptr child) {
   child_ = std::move(child);
@@ -39,6 +78,10 @@ binary_op_node::binary_op_node(binary_op_type type, ast_node_ptr lhs,
                                ast_node_ptr rhs)
     : type_(type), lhs_(std::move(lhs)), rhs_(std::move(rhs)) {}
 
+binary_op_node::~binary_op_node() {
+  release_children(*this);
+}
+
 void binary_op_node::set_type(binary_op_type type) {
   type_ = type;
 }
@@ -71,6 +114,10 @@ ast_node_ptr binary_op_node::ref_rhs() {
 func_node::func_node(std::string name, arg_list args)
     : name_(std::move(name)), args_(std::move(args)) {}
 
+func_node::~func_node() {
+  release_children(*this);
+}
+
 void func_node::set_name(std::string name) {
   name_ = name;
 }
@@ -84,4 +131,38 @@ void id_node::set_name(std::string name) {
   name_ = std::move(name);
 }
 
+
+std::size_t child_count(const ast_node& node) {
+  if (ast_node_cast<const unary_node>(&node)) {
+    return 1;
+  }
+  if (ast_node_cast<const binary_op_node>(&node)) {
+    return 2;
+  }
+  if (auto* func = ast_node_cast<const func_node>(&node)) {
+    return func->args().size();
+  }
+  return 0;
+}
+
+const ast_node* get_child(const ast_node& node, std::size_t idx) {
+  return get_child_slot(const_cast<ast_node&>(node), idx).get();
+}
+
+ast_node_ptr& get_child_slot(ast_node& node, std::size_t idx) {
+  assert(idx < child_count(node) && "Child index out of range");
+
+  if (auto* unary = ast_node_cast<unary_node>(&node)) {
+    return unary->child_;
+  }
+  if (auto* binary = ast_node_cast<binary_op_node>(&node)) {
+    return idx == 0 ? binary->lhs_ : binary->rhs_;
+  }
+  return static_cast<func_node&>(node).args()[idx];
+}
+
+const ast_node_ptr& get_child_slot(const ast_node& node, std::size_t idx) {
+  return get_child_slot(const_cast<ast_node&>(node), idx);
+}
+
 } // namespace mparse
\ No newline at end of file
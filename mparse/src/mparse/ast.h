@@ -1,6 +1,7 @@
 #pragma once
 
 #include "mparse/ast_impl.h"
+#include <cstddef>
 #include <memory>
 #include <string>
 #include <vector>
@@ -51,10 +52,13 @@ public:
   void set_child(ast_node_ptr child);
   ast_node_ptr take_child();
   ast_node_ptr ref_child();
+  const ast_node_ptr& child_ptr() const { return child_; }
 
-  ~unary_node() = 0 {}
+  ~unary_node() = 0;
 
 private:
+  friend ast_node_ptr& get_child_slot(ast_node& node, std::size_t idx);
+
   ast_node_ptr child_;
 };
 
@@ -94,6 +98,7 @@ class binary_op_node : public ast_node_impl<binary_op_node> {
 public:
   binary_op_node() = default;
   binary_op_node(binary_op_type type, ast_node_ptr lhs, ast_node_ptr rhs);
+  ~binary_op_node();
 
   binary_op_type type() const { return type_; }
   void set_type(binary_op_type type);
@@ -107,12 +112,16 @@ public:
   void set_lhs(ast_node_ptr lhs);
   ast_node_ptr take_lhs();
   ast_node_ptr ref_lhs();
+  const ast_node_ptr& lhs_ptr() const { return lhs_; }
 
   void set_rhs(ast_node_ptr rhs);
   ast_node_ptr take_rhs();
   ast_node_ptr ref_rhs();
+  const ast_node_ptr& rhs_ptr() const { return rhs_; }
 
 private:
+  friend ast_node_ptr& get_child_slot(ast_node& node, std::size_t idx);
+
   binary_op_type type_;
   ast_node_ptr lhs_;
   ast_node_ptr rhs_;
@@ -125,6 +134,7 @@ public:
 
   func_node() = default;
   func_node(std::string name, arg_list args);
+  ~func_node();
 
   const std::string& name() const { return name_; }
   void set_name(std::string name);
@@ -163,4 +173,12 @@ private:
   std::string name_;
 };
 
+
+// Generic child access, used by the non-recursive traversals. Children are
+// numbered in evaluation order: operand, lhs and rhs, or function arguments.
+std::size_t child_count(const ast_node& node);
+const ast_node* get_child(const ast_node& node, std::size_t idx);
+ast_node_ptr& get_child_slot(ast_node& node, std::size_t idx);
+const ast_node_ptr& get_child_slot(const ast_node& node, std::size_t idx);
+
 } // namespace mparse
\ No newline at end of file
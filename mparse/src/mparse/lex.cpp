@@ -1,79 +1,366 @@
 #include "lex.h"
 
-using namespace std::literals;
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <charconv>
+#include <cstdint>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MPARSE_LEX_SSE2
+#include <emmintrin.h>
+#endif
 
 namespace {
 
-constexpr auto delims = "+-*/^()|,"sv;
+enum class char_class : std::uint8_t {
+  other,
+  space, // ASCII whitespace
+  digit,
+  alpha,
+  dot,
+  delim,    // delimiter (operator)
+  non_ascii // first byte of a multi-byte UTF-8 sequence
+};
 
-// locale-independent, UTF-8
-constexpr auto whitespace =
-    " \f\n\r\t\v\u00a0\u1680\u180e\u2000\u2001\u2002\u2003\u2004"
-    "\u2005\u2006\u2007\u2008\u2009\u200a\u2028\u2029\u202f\u205f\u3000\ufeff"sv;
+constexpr auto char_classes = [] {
+  std::array<char_class, 256> classes{};
 
-constexpr bool is_digit(char ch) {
-  return ch >= '0' && ch <= '9';
+  for (unsigned char ch : {' ', '\f', '\n', '\r', '\t', '\v'}) {
+    classes[ch] = char_class::space;
+  }
+  for (unsigned char ch = '0'; ch <= '9'; ch++) {
+    classes[ch] = char_class::digit;
+  }
+  for (unsigned char ch = 'a'; ch <= 'z'; ch++) {
+    classes[ch] = char_class::alpha;
+    classes[ch - 'a' + 'A'] = char_class::alpha;
+  }
+  classes['_'] = char_class::alpha;
+  classes['.'] = char_class::dot;
+  for (unsigned char ch : {'+', '-', '*', '/', '^', '(', ')', '|', ','}) {
+    classes[ch] = char_class::delim;
+  }
+  for (std::size_t ch = 0x80; ch < classes.size(); ch++) {
+    classes[ch] = char_class::non_ascii;
+  }
+
+  return classes;
+}();
+
+constexpr char_class classify(char ch) {
+  return char_classes[static_cast<unsigned char>(ch)];
 }
 
-constexpr bool is_alpha(char ch) {
-  return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || ch == '_';
+
+constexpr mparse::delim_type get_delim_type(char ch) {
+  using mparse::delim_type;
+
+  switch (ch) {
+  case '+':
+    return delim_type::plus;
+  case '-':
+    return delim_type::minus;
+  case '*':
+    return delim_type::star;
+  case '/':
+    return delim_type::slash;
+  case '^':
+    return delim_type::caret;
+  case '(':
+    return delim_type::lparen;
+  case ')':
+    return delim_type::rparen;
+  case '|':
+    return delim_type::pipe;
+  case ',':
+    return delim_type::comma;
+  default:
+    return delim_type::none;
+  }
 }
 
-} // namespace
 
-namespace mparse {
+// Character sets scanned in bulk. Each provides a scalar test and, where
+// available, a vectorized test yielding a byte mask for a block of 16 chars.
 
-token get_token(source_stream& stream) {
-  stream.eat_while(whitespace);
+struct space_set {
+  static constexpr bool test(char ch) {
+    return classify(ch) == char_class::space;
+  }
 
-  source_stream::pos_type token_start = stream.pos();
+#ifdef MPARSE_LEX_SSE2
+  static __m128i test_block(__m128i block) {
+    // '\t' through '\r' are contiguous
+    __m128i offset = _mm_sub_epi8(block, _mm_set1_epi8('\t'));
+    __m128i controls = _mm_cmpeq_epi8(
+        _mm_min_epu8(offset, _mm_set1_epi8('\r' - '\t')), offset);
+    return _mm_or_si128(controls, _mm_cmpeq_epi8(block, _mm_set1_epi8(' ')));
+  }
+#endif
+};
+
+struct digit_set {
+  static constexpr bool test(char ch) {
+    return classify(ch) == char_class::digit;
+  }
 
-  if (stream.eof()) {
-    return {.type = token_type::eof,
-            .loc = token_start,
-            .val = stream.token(token_start)};
+#ifdef MPARSE_LEX_SSE2
+  static __m128i test_block(__m128i block) {
+    __m128i offset = _mm_sub_epi8(block, _mm_set1_epi8('0'));
+    return _mm_cmpeq_epi8(_mm_min_epu8(offset, _mm_set1_epi8(9)), offset);
   }
+#endif
+};
 
-  if (stream.eat_one_of(delims)) {
-    return {.type = token_type::delim,
-            .loc = token_start,
-            .val = stream.token(token_start)};
+struct ident_set {
+  static constexpr bool test(char ch) {
+    char_class cls = classify(ch);
+    return cls == char_class::alpha || cls == char_class::digit;
   }
 
-  if (stream.eat_while(is_digit)) {
-    if (stream.eat('.')) {
-      stream.eat_while(is_digit);
+#ifdef MPARSE_LEX_SSE2
+  static __m128i test_block(__m128i block) {
+    // folding to lowercase maps no non-letter onto a letter
+    __m128i lower = _mm_or_si128(block, _mm_set1_epi8(0x20));
+    __m128i offset = _mm_sub_epi8(lower, _mm_set1_epi8('a'));
+    __m128i letters =
+        _mm_cmpeq_epi8(_mm_min_epu8(offset, _mm_set1_epi8('z' - 'a')), offset);
+
+    __m128i underscores = _mm_cmpeq_epi8(block, _mm_set1_epi8('_'));
+    return _mm_or_si128(_mm_or_si128(letters, underscores),
+                        digit_set::test_block(block));
+  }
+#endif
+};
+
+
+// Returns the position of the first character at or after `pos` not in `Set`.
+template <typename Set>
+std::size_t scan_while(std::string_view source, std::size_t pos) {
+#ifdef MPARSE_LEX_SSE2
+  while (source.size() - pos >= 16) {
+    __m128i block =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(source.data() + pos));
+    auto mismatches =
+        ~static_cast<unsigned>(_mm_movemask_epi8(Set::test_block(block))) &
+        0xffff;
+
+    if (mismatches) {
+      return pos + std::countr_zero(mismatches);
     }
-    return {.type = token_type::literal,
-            .loc = token_start,
-            .val = stream.token(token_start)};
+    pos += 16;
+  }
+#endif
+
+  while (pos < source.size() && Set::test(source[pos])) {
+    pos++;
+  }
+  return pos;
+}
+
+
+// Decodes the UTF-8 sequence starting at `pos`, returning its length (0 if it
+// is malformed) and storing the code point in `code_point`.
+std::size_t decode_utf8(std::string_view source, std::size_t pos,
+                        char32_t& code_point) {
+  auto lead = static_cast<unsigned char>(source[pos]);
+
+  std::size_t len = 0;
+  if (lead < 0xc0) {
+    return 0; // stray continuation byte
+  } else if (lead < 0xe0) {
+    len = 2;
+    code_point = lead & 0x1f;
+  } else if (lead < 0xf0) {
+    len = 3;
+    code_point = lead & 0x0f;
+  } else if (lead < 0xf8) {
+    len = 4;
+    code_point = lead & 0x07;
+  } else {
+    return 0;
   }
 
-  if (stream.eat('.')) {
-    if (stream.eat_while(is_digit)) {
-      return {.type = token_type::literal,
-              .loc = token_start,
-              .val = stream.token(token_start)};
+  if (source.size() - pos < len) {
+    return 0;
+  }
+
+  for (std::size_t i = 1; i < len; i++) {
+    auto cont = static_cast<unsigned char>(source[pos + i]);
+    if ((cont & 0xc0) != 0x80) {
+      return 0;
     }
+    code_point = (code_point << 6) | (cont & 0x3f);
+  }
+
+  return len;
+}
 
-    return {.type = token_type::unknown,
-            .loc = token_start,
-            .val = stream.token(token_start)};
+constexpr bool is_unicode_space(char32_t code_point) {
+  switch (code_point) {
+  case 0x00a0:
+  case 0x1680:
+  case 0x180e:
+  case 0x2028:
+  case 0x2029:
+  case 0x202f:
+  case 0x205f:
+  case 0x3000:
+  case 0xfeff:
+    return true;
+  default:
+    return code_point >= 0x2000 && code_point <= 0x200a;
   }
+}
 
-  if (stream.eat(is_alpha)) {
-    stream.eat_while([](char ch) { return is_alpha(ch) || is_digit(ch); });
+// locale-independent, UTF-8
+std::size_t skip_whitespace(std::string_view source, std::size_t pos) {
+  while (true) {
+    pos = scan_while<space_set>(source, pos);
 
-    return {.type = token_type::ident,
-            .loc = token_start,
-            .val = stream.token(token_start)};
+    if (pos == source.size() ||
+        classify(source[pos]) != char_class::non_ascii) {
+      return pos;
+    }
+
+    char32_t code_point;
+    std::size_t len = decode_utf8(source, pos, code_point);
+    if (!len || !is_unicode_space(code_point)) {
+      return pos;
+    }
+    pos += len;
   }
+}
+
+
+double parse_literal(std::string_view val) {
+  double num_val;
+
+  auto status = std::from_chars(val.data(), val.data() + val.size(), num_val,
+                                std::chars_format::fixed);
+  if (status.ec != std::errc{}) {
+    return std::numeric_limits<double>::quiet_NaN();
+  }
+  return num_val;
+}
+
+
+mparse::token lex_token(std::string_view source, std::size_t& pos) {
+  using mparse::token_type;
+
+  pos = skip_whitespace(source, pos);
+  std::size_t token_start = pos;
+
+  auto make_token = [&](token_type type) {
+    return mparse::token{.type = type,
+                         .loc = token_start,
+                         .val = source.substr(token_start, pos - token_start)};
+  };
+
+  if (pos == source.size()) {
+    return make_token(token_type::eof);
+  }
+
+  auto make_literal = [&] {
+    mparse::token tok = make_token(token_type::literal);
+    tok.num_val = parse_literal(tok.val);
+    return tok;
+  };
+
+  switch (classify(source[pos])) {
+  case char_class::delim: {
+    pos++;
+    mparse::token tok = make_token(token_type::delim);
+    tok.delim = get_delim_type(source[token_start]);
+    return tok;
+  }
+
+  case char_class::digit:
+    pos = scan_while<digit_set>(source, pos);
+    if (pos < source.size() && source[pos] == '.') {
+      pos = scan_while<digit_set>(source, pos + 1);
+    }
+    return make_literal();
+
+  case char_class::dot: {
+    std::size_t digits_end = scan_while<digit_set>(source, pos + 1);
+    if (digits_end > pos + 1) {
+      pos = digits_end;
+      return make_literal();
+    }
+
+    pos++;
+    return make_token(token_type::unknown);
+  }
+
+  case char_class::alpha:
+    pos = scan_while<ident_set>(source, pos + 1);
+    return make_token(token_type::ident);
+
+  case char_class::non_ascii: {
+    // give up, but keep the whole character together
+    char32_t code_point;
+    pos += std::max(decode_utf8(source, pos, code_point), std::size_t{1});
+    return make_token(token_type::unknown);
+  }
+
+  default:
+    // give up
+    pos++;
+    return make_token(token_type::unknown);
+  }
+}
+
+} // namespace
+
+namespace mparse {
+
+std::string_view stringify_delim(delim_type delim) {
+  switch (delim) {
+  case delim_type::plus:
+    return "+";
+  case delim_type::minus:
+    return "-";
+  case delim_type::star:
+    return "*";
+  case delim_type::slash:
+    return "/";
+  case delim_type::caret:
+    return "^";
+  case delim_type::lparen:
+    return "(";
+  case delim_type::rparen:
+    return ")";
+  case delim_type::pipe:
+    return "|";
+  case delim_type::comma:
+    return ",";
+  default:
+    return "";
+  }
+}
+
+
+token get_token(source_stream& stream) {
+  std::size_t pos = stream.pos();
+  token tok = lex_token(stream.source(), pos);
+  stream.advance(pos - stream.pos());
+  return tok;
+}
+
+std::vector<token> tokenize(source_stream& stream) {
+  std::vector<token> tokens;
+  std::size_t pos = stream.pos();
+
+  do {
+    tokens.push_back(lex_token(stream.source(), pos));
+  } while (tokens.back().type != token_type::eof);
 
-  // give up
-  stream.next();
-  return {.type = token_type::unknown,
-          .loc = token_start,
-          .val = stream.token(token_start)};
+  stream.advance(pos - stream.pos());
+  return tokens;
 }
 
 } // namespace mparse
\ No newline at end of file
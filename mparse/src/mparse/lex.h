@@ -1,6 +1,7 @@
 #pragma once
 
 #include "mparse/source_stream.h"
+#include <vector>
 
 namespace mparse {
 
@@ -12,12 +13,35 @@ enum class token_type {
   unknown  // error
 };
 
+enum class delim_type {
+  none, // not a delimiter
+  plus,
+  minus,
+  star,
+  slash,
+  caret,
+  lparen,
+  rparen,
+  pipe,
+  comma
+};
+
+std::string_view stringify_delim(delim_type delim);
+
 struct token {
   token_type type;
   std::size_t loc;
   std::string_view val;
+
+  delim_type delim = delim_type::none; // delimiter tokens only
+
+  // Literal tokens only - NaN if the literal could not be parsed.
+  double num_val = 0;
 };
 
 token get_token(source_stream& stream);
 
+// Lexes all remaining input in `stream`, up to and including the eof token.
+std::vector<token> tokenize(source_stream& stream);
+
 } // namespace mparse
\ No newline at end of file
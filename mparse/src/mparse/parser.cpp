@@ -3,8 +3,8 @@
 #include "mparse/ast.h"
 #include "mparse/parse_error.h"
 #include <algorithm>
-#include <array>
-#include <charconv>
+#include <cmath>
+#include <optional>
 #include <string>
 #include <utility>
 #include <vector>
@@ -14,24 +14,37 @@ using namespace std::literals;
 namespace mparse {
 namespace {
 
-template <typename T>
-struct delim_val_mapping {
-  std::string_view tok;
-  T val;
-};
+std::optional<binary_op_type> get_add_op(const token& tok) {
+  switch (tok.delim) {
+  case delim_type::plus:
+    return binary_op_type::add;
+  case delim_type::minus:
+    return binary_op_type::sub;
+  default:
+    return std::nullopt;
+  }
+}
 
-template <typename T, std::size_t N>
-const T* find_delim_val(const delim_val_mapping<T> (&mapping)[N],
-                        const token& tok) {
-  if (tok.type != token_type::delim) {
-    return nullptr;
+std::optional<binary_op_type> get_mult_op(const token& tok) {
+  switch (tok.delim) {
+  case delim_type::star:
+    return binary_op_type::mult;
+  case delim_type::slash:
+    return binary_op_type::div;
+  default:
+    return std::nullopt;
   }
+}
 
-  auto it = std::find_if(std::begin(mapping), std::end(mapping),
-                         [&tok](const delim_val_mapping<T>& entry) {
-                           return entry.tok == tok.val;
-                         });
-  return it == std::end(mapping) ? nullptr : &it->val;
+std::optional<unary_op_type> get_unary_op(const token& tok) {
+  switch (tok.delim) {
+  case delim_type::plus:
+    return unary_op_type::plus;
+  case delim_type::minus:
+    return unary_op_type::neg;
+  default:
+    return std::nullopt;
+  }
 }
 
 
@@ -62,7 +75,7 @@ source_range get_loc(const token& tok) {
 struct parser::parser_impl {
   class term_tok_pusher {
   public:
-    term_tok_pusher(parser_impl& parser, std::string_view tok)
+    term_tok_pusher(parser_impl& parser, delim_type tok)
         : parser_(parser) {
       parser_.push_term_tok(tok);
     }
@@ -90,67 +103,64 @@ struct parser::parser_impl {
   ast_node_ptr consume_func(token name);
 
   template <typename T>
-  ast_node_ptr consume_paren_like(std::string_view term_tok,
+  ast_node_ptr consume_paren_like(delim_type term_tok,
                                   std::string_view friendly_name);
 
   void get_next_token();
-  token cur_token() const { return cur_token_; }
+  const token& cur_token() const { return tokens_[cur_idx_]; }
 
-  void push_term_tok(std::string_view term_tok);
+  void push_term_tok(delim_type term_tok);
   void pop_term_tok();
 
   bool has_term_tok() const;
-  bool has_delim(std::string_view val) const;
+  bool has_delim(delim_type delim) const;
 
-  void check_balanced(source_range open_loc, std::string_view term_tok,
+  void check_balanced(source_range open_loc, delim_type term_tok,
                       std::string_view friendly_name) const;
   void error() const;
 
-  void set_bin_locs(const binary_op_node* node, source_range op_loc);
+  source_range get_span_from(std::size_t first_idx) const;
+  void set_bin_locs(const binary_op_node* node, std::size_t first_idx,
+                    source_range op_loc);
 
-  source_stream& stream_;
   source_map* smap_;
 
-  token cur_token_{token_type::unknown, 0};
+  std::vector<token> tokens_;
+  std::size_t cur_idx_ = 0;
 
   // used for informative error messages
   std::string_view expected_type_;
-  std::vector<std::string_view> term_toks_;
+  std::vector<delim_type> term_toks_;
 };
 
 
 parser::parser_impl::parser_impl(source_stream& stream, source_map* smap)
-    : stream_(stream), smap_(smap) {}
+    : smap_(smap), tokens_(tokenize(stream)) {}
 
 
 void parser::parser_impl::begin_parse() {
-  get_next_token();
+  cur_idx_ = 0;
 }
 
 void parser::parser_impl::end_parse() {
-  if (cur_token_.type != token_type::eof) {
+  if (cur_token().type != token_type::eof) {
     error();
   }
 }
 
 
 ast_node_ptr parser::parser_impl::parse_add() {
-  static constexpr delim_val_mapping<binary_op_type> ops[] = {
-      {"+", binary_op_type::add},
-      {"-", binary_op_type::sub},
-  };
-
-  const binary_op_type* op = nullptr;
+  std::size_t first_idx = cur_idx_;
   ast_node_ptr node = parse_mult();
 
-  while ((op = find_delim_val(ops, cur_token_)) != nullptr) {
-    source_range op_loc = get_loc(cur_token_);
+  while (auto op = get_add_op(cur_token())) {
+    source_range op_loc = get_loc(cur_token());
 
     get_next_token();
     auto add_node =
         make_ast_node<binary_op_node>(*op, std::move(node), parse_mult());
 
-    set_bin_locs(add_node.get(), op_loc);
+    set_bin_locs(add_node.get(), first_idx, op_loc);
     node = std::move(add_node);
   }
 
@@ -158,22 +168,17 @@ ast_node_ptr parser::parser_impl::parse_add() {
 }
 
 ast_node_ptr parser::parser_impl::parse_mult() {
-  static constexpr delim_val_mapping<binary_op_type> ops[] = {
-      {"*", binary_op_type::mult},
-      {"/", binary_op_type::div},
-  };
-
-  const binary_op_type* op = nullptr;
+  std::size_t first_idx = cur_idx_;
   ast_node_ptr node = parse_unary();
 
-  while ((op = find_delim_val(ops, cur_token_)) != nullptr) {
-    source_range op_loc = get_loc(cur_token_);
+  while (auto op = get_mult_op(cur_token())) {
+    source_range op_loc = get_loc(cur_token());
 
     get_next_token();
     auto mul_node =
         make_ast_node<binary_op_node>(*op, std::move(node), parse_unary());
 
-    set_bin_locs(mul_node.get(), op_loc);
+    set_bin_locs(mul_node.get(), first_idx, op_loc);
     node = std::move(mul_node);
   }
 
@@ -181,26 +186,18 @@ ast_node_ptr parser::parser_impl::parse_mult() {
 }
 
 ast_node_ptr parser::parser_impl::parse_unary() {
-  static constexpr delim_val_mapping<unary_op_type> ops[] = {
-      {"+", unary_op_type::plus},
-      {"-", unary_op_type::neg},
-  };
-
-  const unary_op_type* op = find_delim_val(ops, cur_token_);
-  if (op) {
-    source_range op_loc = get_loc(cur_token_);
+  if (auto op = get_unary_op(cur_token())) {
+    std::size_t first_idx = cur_idx_;
+    source_range op_loc = get_loc(cur_token());
 
     get_next_token();
     auto node = make_ast_node<unary_op_node>(*op, parse_unary());
 
     if (smap_) {
-      smap_->set_locs(
-          node.get(),
-          {
-              source_range::merge(
-                  op_loc, smap_->find_primary_loc(node->child())), // full range
-              op_loc                                               // operator
-          });
+      smap_->set_locs(node.get(), {
+                                      get_span_from(first_idx), // full range
+                                      op_loc                    // operator
+                                  });
     }
 
     return node;
@@ -210,16 +207,17 @@ ast_node_ptr parser::parser_impl::parse_unary() {
 }
 
 ast_node_ptr parser::parser_impl::parse_pow() {
+  std::size_t first_idx = cur_idx_;
   ast_node_ptr node = parse_atom();
 
-  if (has_delim("^")) {
-    source_range op_loc = get_loc(cur_token_);
+  if (has_delim(delim_type::caret)) {
+    source_range op_loc = get_loc(cur_token());
 
     get_next_token();
     auto pow_node = make_ast_node<binary_op_node>(
         binary_op_type::pow, std::move(node), parse_unary());
 
-    set_bin_locs(pow_node.get(), op_loc);
+    set_bin_locs(pow_node.get(), first_idx, op_loc);
     return pow_node;
   }
 
@@ -232,14 +230,14 @@ ast_node_ptr parser::parser_impl::parse_atom() {
 
   ast_node_ptr ret = nullptr;
 
-  if (cur_token_.type == token_type::literal) {
+  if (cur_token().type == token_type::literal) {
     ret = consume_literal();
-  } else if (cur_token_.type == token_type::ident) {
+  } else if (cur_token().type == token_type::ident) {
     ret = consume_ident();
-  } else if (has_delim("(")) {
-    ret = consume_paren_like<paren_node>(")", "parentheses");
-  } else if (has_delim("|")) {
-    ret = consume_paren_like<abs_node>("|", "absolute value bars");
+  } else if (has_delim(delim_type::lparen)) {
+    ret = consume_paren_like<paren_node>(delim_type::rparen, "parentheses");
+  } else if (has_delim(delim_type::pipe)) {
+    ret = consume_paren_like<abs_node>(delim_type::pipe, "absolute value bars");
   } else {
     error();
   }
@@ -250,18 +248,15 @@ ast_node_ptr parser::parser_impl::parse_atom() {
 }
 
 ast_node_ptr parser::parser_impl::consume_literal() {
-  std::string_view tok_val = cur_token_.val;
-  double val;
+  double val = cur_token().num_val;
 
-  auto status = std::from_chars(tok_val.data(), tok_val.data() + tok_val.size(),
-                                val, std::chars_format::fixed);
-  if (status.ec != std::errc{}) {
-    throw syntax_error("Error parsing literal", {get_loc(cur_token_)});
+  if (std::isnan(val)) {
+    throw syntax_error("Error parsing literal", {get_loc(cur_token())});
   }
 
   auto node = make_ast_node<literal_node>(val);
   if (smap_) {
-    smap_->set_locs(node.get(), {get_loc(cur_token_)});
+    smap_->set_locs(node.get(), {get_loc(cur_token())});
   }
 
   get_next_token();
@@ -269,9 +264,9 @@ ast_node_ptr parser::parser_impl::consume_literal() {
 }
 
 ast_node_ptr parser::parser_impl::consume_ident() {
-  token name = cur_token_;
+  token name = cur_token();
   get_next_token();
-  if (has_delim("(")) {
+  if (has_delim(delim_type::lparen)) {
     return consume_func(name);
   }
 
@@ -285,26 +280,27 @@ ast_node_ptr parser::parser_impl::consume_ident() {
 
 ast_node_ptr parser::parser_impl::consume_func(token name) {
   source_range name_loc = get_loc(name);
-  source_range open_loc = get_loc(cur_token_);
+  source_range open_loc = get_loc(cur_token());
 
   func_node::arg_list args;
   {
-    term_tok_pusher push_paren(*this, ")");
-    term_tok_pusher push_comma(*this, ",");
+    term_tok_pusher push_paren(*this, delim_type::rparen);
+    term_tok_pusher push_comma(*this, delim_type::comma);
 
     get_next_token();
-    if (!has_delim(")")) {
+    if (!has_delim(delim_type::rparen)) {
       args.push_back(parse_add());
-      while (has_delim(",")) {
+      while (has_delim(delim_type::comma)) {
         get_next_token();
         args.push_back(parse_add());
       }
     }
 
-    check_balanced(open_loc, ")", "parentheses in function call");
+    check_balanced(open_loc, delim_type::rparen,
+                   "parentheses in function call");
   }
 
-  source_range close_loc = get_loc(cur_token_);
+  source_range close_loc = get_loc(cur_token());
 
   get_next_token();
   auto node = make_ast_node<func_node>(std::string(name.val), std::move(args));
@@ -319,8 +315,8 @@ ast_node_ptr parser::parser_impl::consume_func(token name) {
 
 template <typename T>
 ast_node_ptr parser::parser_impl::consume_paren_like(
-    std::string_view term_tok, std::string_view friendly_name) {
-  source_range open_loc = get_loc(cur_token_);
+    delim_type term_tok, std::string_view friendly_name) {
+  source_range open_loc = get_loc(cur_token());
   ast_node_ptr inner_expr;
 
   {
@@ -331,7 +327,7 @@ ast_node_ptr parser::parser_impl::consume_paren_like(
     check_balanced(open_loc, term_tok, friendly_name);
   }
 
-  source_range close_loc = get_loc(cur_token_);
+  source_range close_loc = get_loc(cur_token());
 
   get_next_token();
   auto node = make_ast_node<T>(std::move(inner_expr));
@@ -344,11 +340,14 @@ ast_node_ptr parser::parser_impl::consume_paren_like(
 
 
 void parser::parser_impl::get_next_token() {
-  cur_token_ = get_token(stream_);
+  // the trailing eof token is never consumed
+  if (cur_idx_ + 1 < tokens_.size()) {
+    cur_idx_++;
+  }
 }
 
 
-void parser::parser_impl::push_term_tok(std::string_view term_tok) {
+void parser::parser_impl::push_term_tok(delim_type term_tok) {
   term_toks_.push_back(term_tok);
 }
 
@@ -358,32 +357,34 @@ void parser::parser_impl::pop_term_tok() {
 
 
 bool parser::parser_impl::has_term_tok() const {
-  if (cur_token_.type == token_type::eof) {
+  if (cur_token().type == token_type::eof) {
     return true;
   }
 
-  if (cur_token_.type != token_type::delim) {
+  if (cur_token().type != token_type::delim) {
     return false;
   }
 
-  return std::find(term_toks_.begin(), term_toks_.end(), cur_token_.val) !=
+  return std::find(term_toks_.begin(), term_toks_.end(), cur_token().delim) !=
          term_toks_.end();
 }
 
-bool parser::parser_impl::has_delim(std::string_view val) const {
-  return cur_token_.type == token_type::delim && cur_token_.val == val;
+bool parser::parser_impl::has_delim(delim_type delim) const {
+  return cur_token().delim == delim;
 }
 
 
 void parser::parser_impl::check_balanced(source_range open_loc,
-                                         std::string_view term_tok,
+                                         delim_type term_tok,
                                          std::string_view friendly_name) const {
   if (!has_delim(term_tok)) {
     if (has_term_tok()) {
-      source_range cur_loc = get_loc(cur_token_);
+      source_range cur_loc = get_loc(cur_token());
+      std::string term_str(stringify_delim(term_tok));
+
       throw syntax_error("Unbalanced "s + friendly_name.data() +
-                             ": expected a '" + term_tok.data() + "'",
-                         {open_loc, cur_loc}, term_tok.data(),
+                             ": expected a '" + term_str + "'",
+                         {open_loc, cur_loc}, term_str,
                          static_cast<int>(cur_loc.from()));
     }
     error();
@@ -391,23 +392,28 @@ void parser::parser_impl::check_balanced(source_range open_loc,
 }
 
 void parser::parser_impl::error() const {
-  std::string msg = "Unexpected "s + token_str(cur_token_) + ": expected " +
+  std::string msg = "Unexpected "s + token_str(cur_token()) + ": expected " +
                     std::string(expected_type_);
 
-  throw syntax_error(msg, {get_loc(cur_token_)});
+  throw syntax_error(msg, {get_loc(cur_token())});
 }
 
 
+// Every node covers exactly the tokens consumed while parsing it, so its full
+// range runs from the first of those to the last one consumed so far.
+source_range parser::parser_impl::get_span_from(std::size_t first_idx) const {
+  return source_range::merge(get_loc(tokens_[first_idx]),
+                             get_loc(tokens_[cur_idx_ - 1]));
+}
+
 void parser::parser_impl::set_bin_locs(const binary_op_node* node,
+                                       std::size_t first_idx,
                                        source_range op_loc) {
   if (smap_) {
-    smap_->set_locs(node,
-                    {
-                        source_range::merge(
-                            smap_->find_primary_loc(node->lhs()),
-                            smap_->find_primary_loc(node->rhs())), // full range
-                        op_loc                                     // operator
-                    });
+    smap_->set_locs(node, {
+                              get_span_from(first_idx), // full range
+                              op_loc                    // operator
+                          });
   }
 }
 
@@ -1,25 +1,156 @@
 #include "source_map.h"
 
+#include "mparse/ast.h"
+#include "mparse/parser.h"
+#include "mparse/traversal.h"
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include <typeinfo>
+#include <utility>
+
 namespace mparse {
+namespace {
+
+constexpr std::less<const ast_node*> node_less;
+
+struct post_order_collector : ast_traversal<post_order_collector> {
+  void leave(const ast_node& node) { nodes.push_back(&node); }
+
+  std::vector<const ast_node*> nodes;
+};
+
+} // namespace
+
+
+source_map::source_map(std::string_view source, const ast_node* root)
+    : deferred_source_(source), deferred_root_(root) {}
+
+source_map::source_map(source_map&& other) noexcept {
+  *this = std::move(other);
+}
+
+source_map& source_map::operator=(source_map&& other) noexcept {
+  if (this == &other) {
+    return *this;
+  }
+
+  ranges_ = std::move(other.ranges_);
+  entries_ = std::move(other.entries_);
+  sorted_ = std::exchange(other.sorted_, true);
+
+  deferred_source_ = std::move(other.deferred_source_);
+  deferred_root_ = std::exchange(other.deferred_root_, nullptr);
+  return *this;
+}
+
 
 void source_map::set_locs(const ast_node* node,
-                          std::vector<source_range> locs) {
-  loc_map_[node] = std::move(locs);
+                          std::initializer_list<source_range> locs) {
+  if (ranges_.size() + locs.size() > UINT32_MAX) {
+    throw std::length_error("Too many source locations");
+  }
+
+  entries_.push_back({node, static_cast<std::uint32_t>(ranges_.size()),
+                      static_cast<std::uint32_t>(locs.size())});
+  ranges_.insert(ranges_.end(), locs.begin(), locs.end());
+
+  sorted_ = sorted_ && (entries_.size() == 1 ||
+                        node_less(entries_[entries_.size() - 2].node, node));
 }
 
 util::span<const source_range> source_map::find_locs(
     const ast_node* node) const {
-  auto it = loc_map_.find(node);
+  {
+    std::lock_guard hold(mutex_);
+    resolve_deferred();
+    sort_entries();
+  }
 
-  if (it == loc_map_.end()) {
+  auto it = std::lower_bound(
+      entries_.begin(), entries_.end(), node,
+      [](const loc_entry& entry, const ast_node* node) {
+        return node_less(entry.node, node);
+      });
+
+  if (it == entries_.end() || it->node != node) {
     return {};
   }
-  return it->second;
+  return {ranges_.data() + it->offset, it->count};
 }
 
 
 void source_map::clear() {
-  loc_map_.clear();
+  ranges_.clear();
+  entries_.clear();
+  sorted_ = true;
+
+  deferred_source_.clear();
+  deferred_root_ = nullptr;
+}
+
+
+void source_map::resolve_deferred() const {
+  if (!deferred_root_) {
+    return;
+  }
+
+  source_map reparsed_map;
+  ast_node_ptr reparsed = parse(deferred_source_, &reparsed_map);
+
+  // The parser records nodes in post-order, so as long as the original tree
+  // still has the shape of the reparsed one, the entries line up with a
+  // post-order walk of it.
+  post_order_collector collector;
+  traverse(collector, *deferred_root_);
+
+  post_order_collector reparsed_collector;
+  traverse(reparsed_collector, *reparsed);
+
+  if (collector.nodes.size() != reparsed_collector.nodes.size() ||
+      collector.nodes.size() != reparsed_map.entries_.size() ||
+      !std::equal(collector.nodes.begin(), collector.nodes.end(),
+                  reparsed_collector.nodes.begin(),
+                  [](const ast_node* lhs, const ast_node* rhs) {
+                    return typeid(*lhs) == typeid(*rhs);
+                  })) {
+    throw std::logic_error(
+        "Tree modified before deferred source map was queried");
+  }
+
+  ranges_ = std::move(reparsed_map.ranges_);
+  entries_ = std::move(reparsed_map.entries_);
+
+  for (std::size_t i = 0; i < entries_.size(); i++) {
+    entries_[i].node = collector.nodes[i];
+  }
+  sorted_ = false;
+
+  deferred_source_.clear();
+  deferred_root_ = nullptr;
+}
+
+void source_map::sort_entries() const {
+  if (sorted_) {
+    return;
+  }
+
+  // When a node was assigned locations more than once, the last assignment
+  // wins.
+  std::stable_sort(entries_.begin(), entries_.end(),
+                   [](const loc_entry& lhs, const loc_entry& rhs) {
+                     return node_less(lhs.node, rhs.node);
+                   });
+
+  auto last = entries_.begin();
+  for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+    if (it + 1 == entries_.end() || (it + 1)->node != it->node) {
+      *last++ = *it;
+    }
+  }
+  entries_.erase(last, entries_.end());
+
+  sorted_ = true;
 }
 
 } // namespace mparse
\ No newline at end of file
@@ -1,17 +1,31 @@
 #pragma once
 
+#include "mparse/ast_impl.h"
 #include "mparse/source_range.h"
 #include "util/span.h"
-#include <unordered_map>
+#include <cstdint>
+#include <initializer_list>
+#include <mutex>
+#include <string>
+#include <string_view>
 #include <vector>
 
 namespace mparse {
 
-class ast_node;
-
 class source_map {
 public:
-  void set_locs(const ast_node* node, std::vector<source_range> locs);
+  source_map() = default;
+
+  // Creates a deferred map for `root`, which was parsed from `source`. Nothing
+  // is recorded up front: locations are recomputed by reparsing `source` the
+  // first time they are queried, so `root` must stay alive and unmodified
+  // until then. The map does not keep `root` alive itself.
+  source_map(std::string_view source, const ast_node* root);
+
+  source_map(source_map&& other) noexcept;
+  source_map& operator=(source_map&& other) noexcept;
+
+  void set_locs(const ast_node* node, std::initializer_list<source_range> locs);
   void clear();
 
   util::span<const source_range> find_locs(const ast_node* node) const;
@@ -20,7 +34,29 @@ public:
   }
 
 private:
-  std::unordered_map<const ast_node*, std::vector<source_range>> loc_map_;
+  // Locations of all nodes live back to back in `ranges_`; each entry refers
+  // to a node's slice of that buffer.
+  struct loc_entry {
+    const ast_node* node;
+    std::uint32_t offset;
+    std::uint32_t count;
+  };
+
+  // Both run lazily from const queries, under `mutex_`.
+  void resolve_deferred() const;
+  void sort_entries() const;
+
+  mutable std::mutex mutex_;
+
+  mutable std::vector<source_range> ranges_;
+
+  // Kept in insertion order while the map is being filled, and sorted by node
+  // lazily so that lookups can binary search.
+  mutable std::vector<loc_entry> entries_;
+  mutable bool sorted_ = true;
+
+  mutable std::string deferred_source_;
+  mutable const ast_node* deferred_root_ = nullptr;
 };
 
 } // namespace mparse
\ No newline at end of file
@@ -1,29 +1,38 @@
 #pragma once
 
 #include <algorithm>
+#include <cstdint>
 #include <cstdlib>
 
 namespace mparse {
 
+// Columns are stored as 32 bits to keep source maps compact. Columns past
+// 4 GiB are clamped to the largest representable one.
 class source_range {
 public:
   constexpr source_range() = default;
-  constexpr explicit source_range(std::size_t col) : from_(col), to_(col + 1) {}
+  constexpr explicit source_range(std::size_t col)
+      : source_range(col, col + 1) {}
   constexpr source_range(std::size_t from, std::size_t to)
-      : from_(from), to_(to) {}
+      : from_(clamp(from)), to_(clamp(to)) {}
 
   constexpr std::size_t from() const { return from_; }
   constexpr std::size_t to() const { return to_; }
 
-  constexpr void set_from(std::size_t from) { from_ = from; }
-  constexpr void set_to(std::size_t to) { to_ = to; }
+  constexpr void set_from(std::size_t from) { from_ = clamp(from); }
+  constexpr void set_to(std::size_t to) { to_ = clamp(to); }
 
   static constexpr source_range merge(const source_range& lhs,
                                       const source_range& rhs);
 
 private:
-  std::size_t from_ = 0;
-  std::size_t to_ = 0;
+  static constexpr std::uint32_t clamp(std::size_t col) {
+    return static_cast<std::uint32_t>(
+        std::min<std::size_t>(col, UINT32_MAX));
+  }
+
+  std::uint32_t from_ = 0;
+  std::uint32_t to_ = 0;
 };
 
 constexpr source_range source_range::merge(const source_range& lhs,
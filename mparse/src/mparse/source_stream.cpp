@@ -10,6 +10,11 @@ source_stream::source_type source_stream::token(pos_type token_start) const {
 }
 
 
+void source_stream::advance(pos_type count) {
+  assert(count <= source_.size() - pos_ && "Advancing past end of input");
+  pos_ += count;
+}
+
 source_stream::int_type source_stream::next() {
   if (eof()) {
     return traits_type::eof();
@@ -21,6 +21,7 @@ public:
   source_type token(pos_type token_start) const;
   pos_type pos() const { return pos_; }
 
+  void advance(pos_type count);
   int_type next();
   int_type peek(int lookahead = 0) const;
   int_type cur_char() const { return peek(-1); }
@@ -0,0 +1,71 @@
+#include "static_parser.h"
+
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace mparse {
+
+ast_node_ptr build_static_ast(util::span<const static_node> nodes) {
+  std::vector<ast_node_ptr> built;
+
+  auto pop_built = [&] {
+    ast_node_ptr node = std::move(built.back());
+    built.pop_back();
+    return node;
+  };
+
+  for (const static_node& node : nodes) {
+    ast_node_ptr ret;
+
+    switch (node.type) {
+    case static_node_type::paren:
+      ret = make_ast_node<paren_node>(pop_built());
+      break;
+    case static_node_type::abs:
+      ret = make_ast_node<abs_node>(pop_built());
+      break;
+    case static_node_type::unary_op:
+      ret = make_ast_node<unary_op_node>(node.unary_type, pop_built());
+      break;
+    case static_node_type::binary_op: {
+      ast_node_ptr rhs = pop_built();
+      ast_node_ptr lhs = pop_built();
+      ret = make_ast_node<binary_op_node>(node.binary_type, std::move(lhs),
+                                          std::move(rhs));
+      break;
+    }
+    case static_node_type::func: {
+      func_node::arg_list args(
+          std::make_move_iterator(built.end() - node.child_count),
+          std::make_move_iterator(built.end()));
+      built.resize(built.size() - node.child_count);
+
+      ret = make_ast_node<func_node>(std::string(node.name), std::move(args));
+      break;
+    }
+    case static_node_type::literal:
+      ret = make_ast_node<literal_node>(node.val);
+      break;
+    case static_node_type::id:
+      ret = make_ast_node<id_node>(std::string(node.name));
+      break;
+    }
+
+    built.push_back(std::move(ret));
+  }
+
+  return pop_built();
+}
+
+
+namespace impl {
+
+void static_parse_error(const char* msg) {
+  // only reached if a static parser is run outside of constant evaluation
+  throw std::logic_error(msg);
+}
+
+} // namespace impl
+} // namespace mparse
\ No newline at end of file
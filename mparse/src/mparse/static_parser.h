@@ -0,0 +1,408 @@
+#pragma once
+
+#include "mparse/ast.h"
+#include "mparse/lex.h"
+#include "util/fixed_string.h"
+#include "util/span.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string_view>
+
+namespace mparse {
+
+enum class static_node_type {
+  paren,
+  abs,
+  unary_op,
+  binary_op,
+  func,
+  literal,
+  id,
+};
+
+// Node of an expression parsed at compile time. Nodes are stored in post-order,
+// with the children of each linked through `first_child` and `next_sibling`.
+struct static_node {
+  static constexpr std::size_t npos = std::numeric_limits<std::size_t>::max();
+
+  static_node_type type = static_node_type::literal;
+  unary_op_type unary_type = unary_op_type::plus;   // unary operators only
+  binary_op_type binary_type = binary_op_type::add; // binary operators only
+
+  std::size_t first_child = npos;
+  std::size_t next_sibling = npos;
+  std::size_t child_count = 0;
+
+  double val = 0;             // literals only
+  std::string_view name = {}; // functions and identifiers only
+};
+
+ast_node_ptr build_static_ast(util::span<const static_node> nodes);
+
+
+template <std::size_t N>
+struct static_ast {
+  std::array<static_node, N> nodes{};
+  std::size_t node_count = 0;
+
+  constexpr std::size_t root() const { return node_count - 1; }
+
+  // Returns the index of child `n` of node `idx`.
+  constexpr std::size_t child(std::size_t idx, std::size_t n) const {
+    std::size_t cur = nodes[idx].first_child;
+    for (; n > 0; n--) {
+      cur = nodes[cur].next_sibling;
+    }
+    return cur;
+  }
+
+  ast_node_ptr to_ast() const {
+    return build_static_ast({nodes.data(), nodes.data() + node_count});
+  }
+};
+
+
+namespace impl {
+
+// Not usable in constant expressions: reaching it while parsing at compile time
+// turns `msg` into a compiler diagnostic.
+void static_parse_error(const char* msg);
+
+// Parses literals exactly like `std::from_chars`, rejecting those for which
+// that cannot be guaranteed with plain double arithmetic.
+constexpr double parse_static_literal(std::string_view val) {
+  std::uint64_t mantissa = 0;
+  int frac_digits = 0;
+  bool seen_dot = false;
+
+  for (char ch : val) {
+    if (ch == '.') {
+      seen_dot = true;
+      continue;
+    }
+
+    auto digit = static_cast<std::uint64_t>(ch - '0');
+    if (mantissa > (std::numeric_limits<std::uint64_t>::max() - digit) / 10) {
+      static_parse_error("Literal has too many digits");
+    }
+
+    mantissa = mantissa * 10 + digit;
+    frac_digits += seen_dot;
+  }
+
+  while (frac_digits > 0 && mantissa % 10 == 0) {
+    mantissa /= 10;
+    frac_digits--;
+  }
+
+  if (frac_digits == 0) {
+    return static_cast<double>(mantissa); // correctly rounded
+  }
+
+  // Both operands are exact, so the quotient is correctly rounded.
+  if (mantissa > (std::uint64_t{1} << 53) || frac_digits > 22) {
+    static_parse_error("Literal is too precise to be parsed at compile time");
+  }
+
+  double divisor = 1;
+  for (int i = 0; i < frac_digits; i++) {
+    divisor *= 10;
+  }
+  return static_cast<double>(mantissa) / divisor;
+}
+
+
+// Compile-time counterpart of `parser`, for the same grammar. `N` bounds the
+// number of nodes.
+template <std::size_t N>
+class static_parser {
+public:
+  constexpr explicit static_parser(std::string_view source) : source_(source) {
+    get_next_token();
+  }
+
+  constexpr static_ast<N> parse() {
+    parse_add();
+    if (tok_.type != token_type::eof) {
+      static_parse_error("Unexpected token: expected an operator");
+    }
+    return ast_;
+  }
+
+private:
+  constexpr std::size_t parse_add() {
+    std::size_t node = parse_mult();
+
+    while (tok_.delim == delim_type::plus || tok_.delim == delim_type::minus) {
+      auto op = tok_.delim == delim_type::plus ? binary_op_type::add
+                                               : binary_op_type::sub;
+      get_next_token();
+      node = add_binary(op, node, parse_mult());
+    }
+
+    return node;
+  }
+
+  constexpr std::size_t parse_mult() {
+    std::size_t node = parse_unary();
+
+    while (tok_.delim == delim_type::star || tok_.delim == delim_type::slash) {
+      auto op = tok_.delim == delim_type::star ? binary_op_type::mult
+                                               : binary_op_type::div;
+      get_next_token();
+      node = add_binary(op, node, parse_unary());
+    }
+
+    return node;
+  }
+
+  constexpr std::size_t parse_unary() {
+    if (tok_.delim == delim_type::plus || tok_.delim == delim_type::minus) {
+      auto op = tok_.delim == delim_type::plus ? unary_op_type::plus
+                                               : unary_op_type::neg;
+      get_next_token();
+      std::size_t child = parse_unary();
+
+      return add_node({.type = static_node_type::unary_op,
+                       .unary_type = op,
+                       .first_child = child,
+                       .child_count = 1});
+    }
+
+    return parse_pow();
+  }
+
+  constexpr std::size_t parse_pow() {
+    std::size_t node = parse_atom();
+
+    if (tok_.delim == delim_type::caret) {
+      get_next_token();
+      return add_binary(binary_op_type::pow, node, parse_unary());
+    }
+
+    return node;
+  }
+
+  constexpr std::size_t parse_atom() {
+    if (tok_.type == token_type::literal) {
+      double val = parse_static_literal(tok_.val);
+      get_next_token();
+      return add_node({.type = static_node_type::literal, .val = val});
+    }
+
+    if (tok_.type == token_type::ident) {
+      std::string_view name = tok_.val;
+      get_next_token();
+
+      if (tok_.delim == delim_type::lparen) {
+        return parse_func(name);
+      }
+      return add_node({.type = static_node_type::id, .name = name});
+    }
+
+    if (tok_.delim == delim_type::lparen) {
+      return parse_paren_like(static_node_type::paren, delim_type::rparen,
+                              "Unbalanced parentheses: expected a ')'");
+    }
+
+    if (tok_.delim == delim_type::pipe) {
+      return parse_paren_like(
+          static_node_type::abs, delim_type::pipe,
+          "Unbalanced absolute value bars: expected a '|'");
+    }
+
+    static_parse_error("Unexpected token: expected an expression");
+    return 0;
+  }
+
+  constexpr std::size_t parse_func(std::string_view name) {
+    std::size_t first_arg = static_node::npos;
+    std::size_t arg_count = 0;
+
+    get_next_token();
+    if (tok_.delim != delim_type::rparen) {
+      first_arg = parse_add();
+      std::size_t last_arg = first_arg;
+      arg_count++;
+
+      while (tok_.delim == delim_type::comma) {
+        get_next_token();
+        std::size_t arg = parse_add();
+
+        ast_.nodes[last_arg].next_sibling = arg;
+        last_arg = arg;
+        arg_count++;
+      }
+    }
+
+    expect(delim_type::rparen,
+           "Unbalanced parentheses in function call: expected a ')'");
+
+    return add_node({.type = static_node_type::func,
+                     .first_child = first_arg,
+                     .child_count = arg_count,
+                     .name = name});
+  }
+
+  constexpr std::size_t parse_paren_like(static_node_type type,
+                                         delim_type term_tok,
+                                         const char* unbalanced_msg) {
+    get_next_token();
+    std::size_t inner = parse_add();
+    expect(term_tok, unbalanced_msg);
+
+    return add_node({.type = type, .first_child = inner, .child_count = 1});
+  }
+
+
+  constexpr std::size_t add_node(static_node node) {
+    if (ast_.node_count == N) {
+      static_parse_error("Too many nodes");
+    }
+
+    ast_.nodes[ast_.node_count] = node;
+    return ast_.node_count++;
+  }
+
+  constexpr std::size_t add_binary(binary_op_type op, std::size_t lhs,
+                                   std::size_t rhs) {
+    ast_.nodes[lhs].next_sibling = rhs;
+    return add_node({.type = static_node_type::binary_op,
+                     .binary_type = op,
+                     .first_child = lhs,
+                     .child_count = 2});
+  }
+
+  constexpr void expect(delim_type delim, const char* msg) {
+    if (tok_.delim != delim) {
+      static_parse_error(msg);
+    }
+    get_next_token();
+  }
+
+
+  static constexpr bool is_digit(char ch) { return ch >= '0' && ch <= '9'; }
+
+  static constexpr bool is_ident_start(char ch) {
+    return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || ch == '_';
+  }
+
+  static constexpr delim_type get_delim_type(char ch) {
+    switch (ch) {
+    case '+':
+      return delim_type::plus;
+    case '-':
+      return delim_type::minus;
+    case '*':
+      return delim_type::star;
+    case '/':
+      return delim_type::slash;
+    case '^':
+      return delim_type::caret;
+    case '(':
+      return delim_type::lparen;
+    case ')':
+      return delim_type::rparen;
+    case '|':
+      return delim_type::pipe;
+    case ',':
+      return delim_type::comma;
+    default:
+      return delim_type::none;
+    }
+  }
+
+  // Only ASCII whitespace is supported here.
+  constexpr void get_next_token() {
+    while (pos_ < source_.size() &&
+           std::string_view(" \f\n\r\t\v").find(source_[pos_]) !=
+               std::string_view::npos) {
+      pos_++;
+    }
+
+    std::size_t start = pos_;
+    tok_ = {};
+
+    auto scan_digits = [&] {
+      while (pos_ < source_.size() && is_digit(source_[pos_])) {
+        pos_++;
+      }
+    };
+
+    if (pos_ == source_.size()) {
+      tok_.type = token_type::eof;
+    } else if (auto delim = get_delim_type(source_[pos_]);
+               delim != delim_type::none) {
+      pos_++;
+      tok_.type = token_type::delim;
+      tok_.delim = delim;
+    } else if (is_digit(source_[pos_]) ||
+               (source_[pos_] == '.' && pos_ + 1 < source_.size() &&
+                is_digit(source_[pos_ + 1]))) {
+      scan_digits();
+      if (pos_ < source_.size() && source_[pos_] == '.') {
+        pos_++;
+        scan_digits();
+      }
+      tok_.type = token_type::literal;
+    } else if (is_ident_start(source_[pos_])) {
+      while (pos_ < source_.size() &&
+             (is_ident_start(source_[pos_]) || is_digit(source_[pos_]))) {
+        pos_++;
+      }
+      tok_.type = token_type::ident;
+    } else {
+      static_parse_error("Unexpected character");
+    }
+
+    tok_.val = source_.substr(start, pos_ - start);
+  }
+
+
+  struct static_token {
+    token_type type = token_type::unknown;
+    std::string_view val;
+    delim_type delim = delim_type::none;
+  };
+
+  std::string_view source_;
+  std::size_t pos_ = 0;
+  static_token tok_;
+
+  static_ast<N> ast_;
+};
+
+} // namespace impl
+
+
+// Expression parsed entirely at compile time; see `_mexpr`. Its structure is
+// available to the compiler through `tree`, and it converts to an ordinary tree
+// when needed.
+template <util::fixed_string Source>
+struct static_expr {
+  static constexpr std::string_view source = Source.view();
+
+  static constexpr std::size_t node_count =
+      impl::static_parser<Source.size()>(source).parse().node_count;
+
+  static constexpr static_ast<node_count> tree =
+      impl::static_parser<node_count>(source).parse();
+
+  ast_node_ptr to_ast() const { return tree.to_ast(); }
+  operator ast_node_ptr() const { return to_ast(); }
+};
+
+inline namespace literals {
+
+// "x^2 + sin(y)"_mexpr parses the expression at compile time, reporting syntax
+// errors as compiler diagnostics.
+template <util::fixed_string Source>
+constexpr static_expr<Source> operator""_mexpr() {
+  return {};
+}
+
+} // namespace literals
+
+} // namespace mparse
\ No newline at end of file
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "mparse/ast.h"
+#include <cstddef>
+#include <vector>
+
+namespace mparse {
+
+// Base for handlers passed to `traverse`. Derived classes hide whichever hooks
+// they are interested in:
+//  - enter(node) is invoked before any of the node's children are visited
+//  - enter_child(parent, idx) is invoked right before child `idx` is entered
+//  - leave(node) is invoked once all of the node's children have been left
+template <typename D>
+struct ast_traversal {
+  void enter(const ast_node&) {}
+  void enter_child(const ast_node&, std::size_t) {}
+  void leave(const ast_node&) {}
+};
+
+
+// Walks the tree rooted at `root` depth-first, using an explicit stack instead
+// of the call stack so that arbitrarily deep trees can be processed.
+template <typename D>
+void traverse(ast_traversal<D>& trav, const ast_node& root) {
+  struct frame {
+    const ast_node* node;
+    std::size_t next_child;
+    std::size_t child_count;
+  };
+
+  auto& handler = static_cast<D&>(trav);
+  std::vector<frame> stack;
+
+  handler.enter(root);
+  stack.push_back({&root, 0, child_count(root)});
+
+  while (!stack.empty()) {
+    frame& top = stack.back();
+    const ast_node& node = *top.node;
+
+    if (top.next_child == top.child_count) {
+      stack.pop_back();
+      handler.leave(node);
+      continue;
+    }
+
+    std::size_t idx = top.next_child++;
+    const ast_node& child = *get_child(node, idx);
+
+    handler.enter_child(node, idx);
+    handler.enter(child);
+    stack.push_back({&child, 0, child_count(child)});
+  }
+}
+
+} // namespace mparse
\ No newline at end of file
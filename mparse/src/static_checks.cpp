@@ -0,0 +1,42 @@
+// Compile-time checks of the static parser and evaluator, which nothing else
+// instantiates. This file only holds declarations and emits no code.
+
+#include "ast_ops/eval/static_eval.h"
+#include "mparse/static_parser.h"
+#include <array>
+#include <string_view>
+
+namespace {
+
+using namespace mparse::literals;
+
+using checked_expr = decltype("x^2 + sin(y, 3)"_mexpr);
+
+constexpr const auto& checked_tree = checked_expr::tree;
+constexpr const auto& checked_root = checked_tree.nodes[checked_tree.root()];
+constexpr const auto& checked_func =
+    checked_tree.nodes[checked_tree.child(checked_tree.root(), 1)];
+
+static_assert(checked_expr::node_count == 7);
+static_assert(checked_root.type == mparse::static_node_type::binary_op &&
+              checked_root.binary_type == mparse::binary_op_type::add);
+static_assert(checked_func.type == mparse::static_node_type::func &&
+              checked_func.name == "sin" && checked_func.child_count == 2);
+
+
+// Static expressions bind the builtins at compile time, so check them against
+// the builtin tables.
+using checked_static_expr = mparse::static_expr<"x * pi + max(y, e, x)">;
+
+static_assert(ast_ops::static_vars<checked_static_expr> ==
+              std::array<std::string_view, 2>{"x", "y"});
+static_assert(ast_ops::impl::find_builtin_func("max") <
+              ast_ops::impl::builtin_func_count);
+
+// Never called, but makes the compiler instantiate (and so check) the
+// evaluation of every node; being inline, it is not emitted.
+inline ast_ops::number eval_checked_static_expr(double x, double y) {
+  return ast_ops::eval(checked_static_expr{}, x, y);
+}
+
+} // namespace
\ No newline at end of file
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <utility>
+
+namespace util {
+
+// Owning pointer to a value shared between copies until one of them modifies
+// it. Copying marks both the source and the copy as shared, and shared values
+// are copied before being modified. Unlike checking the reference count, this
+// does not depend on other threads releasing their copies: once shared, a
+// value is never modified in place again, so readers of any copy need no
+// synchronization with writers of another.
+template <typename T>
+class cow_ptr {
+public:
+  cow_ptr() = default;
+  explicit cow_ptr(std::shared_ptr<T> ptr) : ptr_(std::move(ptr)) {}
+
+  cow_ptr(const cow_ptr& other) : ptr_(other.share()), shared_(true) {}
+  cow_ptr(cow_ptr&& other) noexcept
+      : ptr_(std::move(other.ptr_)), shared_(other.is_shared()) {}
+
+  cow_ptr& operator=(const cow_ptr& other) {
+    if (this != &other) {
+      ptr_ = other.share();
+      shared_.store(true, std::memory_order_relaxed);
+    }
+    return *this;
+  }
+
+  cow_ptr& operator=(cow_ptr&& other) noexcept {
+    ptr_ = std::move(other.ptr_);
+    shared_.store(other.is_shared(), std::memory_order_relaxed);
+    return *this;
+  }
+
+  const T* get() const { return ptr_.get(); }
+  const T& operator*() const { return *ptr_; }
+  const T* operator->() const { return ptr_.get(); }
+  explicit operator bool() const { return ptr_ != nullptr; }
+
+  // Returns the value for modification, creating it if there is none and
+  // copying it if it is shared.
+  T& own() {
+    if (!ptr_) {
+      ptr_ = std::make_shared<T>();
+    } else if (is_shared()) {
+      ptr_ = std::make_shared<T>(*ptr_);
+    }
+    shared_.store(false, std::memory_order_relaxed);
+    return *ptr_;
+  }
+
+  void reset() {
+    ptr_.reset();
+    shared_.store(false, std::memory_order_relaxed);
+  }
+
+private:
+  // Copies may be made from several threads at once, hence the atomic flag.
+  // Modifying a pointer while it is being copied is a race in any case, so the
+  // flag needs no ordering of its own.
+  std::shared_ptr<T> share() const {
+    shared_.store(true, std::memory_order_relaxed);
+    return ptr_;
+  }
+
+  bool is_shared() const { return shared_.load(std::memory_order_relaxed); }
+
+  std::shared_ptr<T> ptr_;
+  mutable std::atomic<bool> shared_ = false;
+};
+
+} // namespace util
\ No newline at end of file
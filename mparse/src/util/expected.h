@@ -0,0 +1,56 @@
+#pragma once
+
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+namespace util {
+
+template <typename E>
+class unexpected {
+public:
+  explicit unexpected(E err) : err_(std::move(err)) {}
+
+  E& error() & { return err_; }
+  const E& error() const& { return err_; }
+  E&& error() && { return std::move(err_); }
+
+private:
+  E err_;
+};
+
+
+// Either a value or the error that prevented computing it, for reporting
+// errors on hot paths without throwing.
+template <typename T, typename E>
+class expected {
+public:
+  template <typename U = T,
+            typename = std::enable_if_t<std::is_convertible_v<U, T>>>
+  expected(U&& val) : storage_(std::in_place_index<0>, std::forward<U>(val)) {}
+
+  template <typename G,
+            typename = std::enable_if_t<std::is_convertible_v<G, E>>>
+  expected(unexpected<G> err)
+      : storage_(std::in_place_index<1>, std::move(err).error()) {}
+
+  bool has_value() const { return storage_.index() == 0; }
+  explicit operator bool() const { return has_value(); }
+
+  T& value() & { return *std::get_if<0>(&storage_); }
+  const T& value() const& { return *std::get_if<0>(&storage_); }
+
+  T& operator*() & { return value(); }
+  const T& operator*() const& { return value(); }
+  T* operator->() { return &value(); }
+  const T* operator->() const { return &value(); }
+
+  E& error() & { return *std::get_if<1>(&storage_); }
+  const E& error() const& { return *std::get_if<1>(&storage_); }
+  E&& error() && { return std::move(*std::get_if<1>(&storage_)); }
+
+private:
+  std::variant<T, E> storage_;
+};
+
+} // namespace util
\ No newline at end of file
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <string_view>
+
+namespace util {
+
+// String usable as a template argument, e.g. to receive the contents of a
+// string literal in a literal operator template.
+template <std::size_t N>
+struct fixed_string {
+  constexpr fixed_string(const char (&str)[N]) {
+    std::copy_n(str, N, chars);
+  }
+
+  constexpr std::string_view view() const { return {chars, N - 1}; }
+  constexpr std::size_t size() const { return N - 1; }
+
+  char chars[N];
+};
+
+} // namespace util
\ No newline at end of file
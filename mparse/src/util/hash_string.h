@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+namespace util {
+
+constexpr std::uint32_t hash_string(std::string_view str,
+                                    std::uint32_t seed = 0) {
+  // FNV-1a, with a final mix so that the low bits depend on every character
+  std::uint32_t hash = 2166136261u ^ seed;
+  for (char c : str) {
+    hash ^= static_cast<unsigned char>(c);
+    hash *= 16777619u;
+  }
+
+  hash ^= hash >> 16;
+  hash *= 0x45d9f3bu;
+  hash ^= hash >> 16;
+  return hash;
+}
+
+// String hashed ahead of time, for looking it up in several maps while hashing
+// it only once.
+struct hashed_string {
+  constexpr explicit hashed_string(std::string_view str)
+      : str(str), hash(hash_string(str)) {}
+
+  std::string_view str;
+  std::uint32_t hash;
+};
+
+} // namespace util
\ No newline at end of file
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace util {
+
+// Fixed set of worker threads, reused by every `parallel_for`. They are only
+// started by the first call with more than one index, so a pool that ends up
+// with nothing to spread costs no more than a mutex.
+class thread_pool {
+public:
+  // By default, one worker per hardware thread besides the calling one.
+  thread_pool() : thread_pool(default_worker_count()) {}
+  explicit thread_pool(std::size_t worker_count)
+      : worker_count_(worker_count) {}
+  ~thread_pool();
+
+  thread_pool(const thread_pool&) = delete;
+  thread_pool& operator=(const thread_pool&) = delete;
+
+  std::size_t worker_count() const { return worker_count_; }
+
+  // Invokes `func(i)` for every `i` in [0, count), spreading the calls over
+  // the workers and the calling thread. Returns once all calls have
+  // completed; `func` must not throw. Calls from several threads are run one
+  // after the other.
+  template <typename F>
+  void parallel_for(std::size_t count, F&& func);
+
+private:
+  struct job {
+    void (*invoke)(void* func, std::size_t idx);
+    void* func;
+    std::size_t count;
+  };
+
+  static std::size_t default_worker_count() {
+    return std::max(std::thread::hardware_concurrency(), 1u) - 1;
+  }
+
+  void start();
+  void run(const job& cur);
+  void work();
+
+  std::size_t worker_count_;
+  std::vector<std::thread> workers_; // empty until started
+
+  std::mutex submit_mutex_; // held for the duration of a `parallel_for`
+
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable done_;
+
+  job job_ = {};
+  bool job_open_ = false;
+  std::uint64_t generation_ = 0;
+  std::size_t active_ = 0;
+  bool stop_ = false;
+
+  std::atomic<std::size_t> next_idx_ = 0;
+};
+
+inline thread_pool::~thread_pool() {
+  {
+    std::lock_guard hold(mutex_);
+    stop_ = true;
+  }
+  wake_.notify_all();
+
+  for (auto& worker : workers_) {
+    worker.join();
+  }
+}
+
+template <typename F>
+void thread_pool::parallel_for(std::size_t count, F&& func) {
+  using func_type = std::remove_reference_t<F>;
+
+  job cur = {[](void* func, std::size_t idx) {
+               (*static_cast<func_type*>(func))(idx);
+             },
+             const_cast<void*>(static_cast<const void*>(std::addressof(func))),
+             count};
+
+  std::lock_guard serial(submit_mutex_);
+
+  if (count < 2 || worker_count_ == 0) {
+    run(cur); // nothing to spread
+    return;
+  }
+
+  if (workers_.empty()) {
+    start();
+  }
+
+  {
+    std::lock_guard hold(mutex_);
+    job_ = cur;
+    job_open_ = true;
+    next_idx_.store(0, std::memory_order_relaxed);
+    generation_++;
+  }
+  wake_.notify_all();
+
+  run(cur);
+
+  // Close the job before waiting, so that workers waking up late don't join
+  // once `func` is gone.
+  std::unique_lock lock(mutex_);
+  job_open_ = false;
+  done_.wait(lock, [&] { return active_ == 0; });
+}
+
+inline void thread_pool::start() {
+  workers_.reserve(worker_count_);
+  for (std::size_t i = 0; i < worker_count_; i++) {
+    workers_.emplace_back([this] { work(); });
+  }
+}
+
+inline void thread_pool::run(const job& cur) {
+  std::size_t idx;
+  while ((idx = next_idx_.fetch_add(1, std::memory_order_relaxed)) <
+         cur.count) {
+    cur.invoke(cur.func, idx);
+  }
+}
+
+inline void thread_pool::work() {
+  std::uint64_t seen = 0;
+
+  std::unique_lock lock(mutex_);
+  while (true) {
+    wake_.wait(lock, [&] { return stop_ || generation_ != seen; });
+    if (stop_) {
+      return;
+    }
+
+    seen = generation_;
+    if (!job_open_) {
+      continue;
+    }
+
+    job cur = job_;
+    active_++;
+    lock.unlock();
+
+    run(cur);
+
+    lock.lock();
+    if (--active_ == 0) {
+      done_.notify_all();
+    }
+  }
+}
+
+} // namespace util
\ No newline at end of file
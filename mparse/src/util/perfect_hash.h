@@ -0,0 +1,64 @@
+#pragma once
+
+#include "util/hash_string.h"
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string_view>
+
+namespace util {
+
+// Index of a set of distinct strings, built at compile time. The hash seed is
+// chosen so that no two keys share a slot: lookups hash once and compare
+// against at most one key. `find` returns the index of `key` in the original
+// array, or `size()` if it is absent.
+template <std::size_t N>
+class perfect_hash {
+public:
+  constexpr explicit perfect_hash(const std::array<std::string_view, N>& keys)
+      : keys_(keys) {
+    while (!try_seed()) {
+      seed_++;
+    }
+  }
+
+  constexpr std::size_t size() const { return N; }
+
+  constexpr std::size_t find(std::string_view key) const {
+    std::size_t idx = slots_[slot_of(key)];
+    return idx < N && keys_[idx] == key ? idx : N;
+  }
+
+private:
+  // Sparse enough that a working seed is found after a few attempts.
+  static constexpr std::size_t slot_count = std::bit_ceil(N * 4 + 1);
+
+  constexpr std::size_t slot_of(std::string_view key) const {
+    return hash_string(key, seed_) & (slot_count - 1);
+  }
+
+  constexpr bool try_seed() {
+    slots_.fill(N);
+
+    for (std::size_t i = 0; i < N; i++) {
+      std::size_t& slot = slots_[slot_of(keys_[i])];
+      if (slot != N) {
+        if (keys_[slot] == keys_[i]) {
+          throw std::invalid_argument("Duplicate key in perfect hash");
+        }
+        return false;
+      }
+      slot = i;
+    }
+
+    return true;
+  }
+
+  std::array<std::string_view, N> keys_;
+  std::array<std::size_t, slot_count> slots_{};
+  std::uint32_t seed_ = 0;
+};
+
+} // namespace util
\ No newline at end of file
@@ -0,0 +1,198 @@
+#pragma once
+
+#include "util/hash_string.h"
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace util {
+
+// Map from strings to `V`, as a flat open-addressing hash table with linear
+// probing. Entries are stored densely in insertion order, and the table holds
+// only their indices and hashes, so probing never touches the keys unless the
+// hashes match.
+template <typename V>
+class string_map {
+public:
+  using value_type = std::pair<std::string, V>;
+  using const_iterator = typename std::vector<value_type>::const_iterator;
+
+  string_map() = default;
+  string_map(std::initializer_list<value_type> ilist);
+
+  std::size_t size() const { return entries_.size(); }
+  bool empty() const { return entries_.empty(); }
+
+  const_iterator begin() const { return entries_.begin(); }
+  const_iterator end() const { return entries_.end(); }
+
+  void reserve(std::size_t count);
+  void clear();
+
+  const V* find(const hashed_string& key) const;
+  const V* find(std::string_view key) const {
+    return find(hashed_string(key));
+  }
+
+  void insert_or_assign(std::string key, V val);
+  void erase(std::string_view key);
+
+private:
+  static constexpr std::uint32_t empty_slot = UINT32_MAX;
+
+  struct slot {
+    std::uint32_t hash;
+    std::uint32_t index = empty_slot;
+  };
+
+  // Returns the slot holding `key`, or the empty slot ending its probe
+  // sequence.
+  std::size_t probe(const hashed_string& key) const;
+  std::size_t probe_index(std::uint32_t hash, std::uint32_t index) const;
+
+  void rehash(std::size_t slot_count);
+
+  std::size_t mask() const { return slots_.size() - 1; }
+
+  std::vector<value_type> entries_;
+  std::vector<std::uint32_t> hashes_; // of `entries_`, by index
+  std::vector<slot> slots_;           // empty or a power of two in size
+};
+
+template <typename V>
+string_map<V>::string_map(std::initializer_list<value_type> ilist) {
+  reserve(ilist.size());
+  for (const auto& [key, val] : ilist) {
+    insert_or_assign(key, val);
+  }
+}
+
+template <typename V>
+void string_map<V>::reserve(std::size_t count) {
+  // keep the table at most half full
+  std::size_t slot_count = 8;
+  while (slot_count < count * 2) {
+    slot_count *= 2;
+  }
+
+  if (slot_count > slots_.size()) {
+    rehash(slot_count);
+  }
+  entries_.reserve(count);
+  hashes_.reserve(count);
+}
+
+template <typename V>
+void string_map<V>::clear() {
+  entries_.clear();
+  hashes_.clear();
+  slots_.clear();
+}
+
+template <typename V>
+const V* string_map<V>::find(const hashed_string& key) const {
+  if (slots_.empty()) {
+    return nullptr;
+  }
+
+  const slot& found = slots_[probe(key)];
+  if (found.index == empty_slot) {
+    return nullptr;
+  }
+  return &entries_[found.index].second;
+}
+
+template <typename V>
+void string_map<V>::insert_or_assign(std::string key, V val) {
+  if ((entries_.size() + 1) * 2 > slots_.size()) {
+    rehash(slots_.empty() ? 8 : slots_.size() * 2);
+  }
+
+  hashed_string hashed(key);
+  slot& found = slots_[probe(hashed)];
+  if (found.index != empty_slot) {
+    entries_[found.index].second = std::move(val);
+    return;
+  }
+
+  found = {hashed.hash, static_cast<std::uint32_t>(entries_.size())};
+  hashes_.push_back(hashed.hash);
+  entries_.emplace_back(std::move(key), std::move(val));
+}
+
+template <typename V>
+void string_map<V>::erase(std::string_view key) {
+  if (slots_.empty()) {
+    return;
+  }
+
+  std::size_t hole = probe(hashed_string(key));
+  std::uint32_t index = slots_[hole].index;
+  if (index == empty_slot) {
+    return;
+  }
+
+  // Shift later members of the probe sequence back over the erased slot, so
+  // that no tombstones are needed. A slot may move into the hole unless its
+  // home slot lies cyclically in (hole, next].
+  for (std::size_t next = (hole + 1) & mask();
+       slots_[next].index != empty_slot; next = (next + 1) & mask()) {
+    std::size_t home = slots_[next].hash & mask();
+    if (((next - home) & mask()) >= ((next - hole) & mask())) {
+      slots_[hole] = slots_[next];
+      hole = next;
+    }
+  }
+  slots_[hole].index = empty_slot;
+
+  // Fill the erased entry with the last one, keeping entries dense.
+  auto last = static_cast<std::uint32_t>(entries_.size() - 1);
+  if (index != last) {
+    slots_[probe_index(hashes_[last], last)].index = index;
+    entries_[index] = std::move(entries_.back());
+    hashes_[index] = hashes_[last];
+  }
+  entries_.pop_back();
+  hashes_.pop_back();
+}
+
+template <typename V>
+std::size_t string_map<V>::probe(const hashed_string& key) const {
+  std::size_t pos = key.hash & mask();
+  while (true) {
+    const slot& cur = slots_[pos];
+    if (cur.index == empty_slot ||
+        (cur.hash == key.hash && entries_[cur.index].first == key.str)) {
+      return pos;
+    }
+    pos = (pos + 1) & mask();
+  }
+}
+
+template <typename V>
+std::size_t string_map<V>::probe_index(std::uint32_t hash,
+                                       std::uint32_t index) const {
+  std::size_t pos = hash & mask();
+  while (slots_[pos].index != index) {
+    pos = (pos + 1) & mask();
+  }
+  return pos;
+}
+
+template <typename V>
+void string_map<V>::rehash(std::size_t slot_count) {
+  slots_.assign(slot_count, slot{});
+  for (std::uint32_t i = 0; i < entries_.size(); i++) {
+    std::size_t pos = hashes_[i] & mask();
+    while (slots_[pos].index != empty_slot) {
+      pos = (pos + 1) & mask();
+    }
+    slots_[pos] = {hashes_[i], i};
+  }
+}
+
+} // namespace util
\ No newline at end of file